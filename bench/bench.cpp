@@ -0,0 +1,517 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../include/model.h"
+#include "../include/tgaimage.h"
+#include "../include/rasterizer.h"
+#include "../include/shader.h"
+#include "../include/job_system.h"
+#include "../include/frame_arena.h"
+#include "../include/visibility.h"
+#include "../include/instancing.h"
+#include "../include/OBB2D.h"
+
+// ==========================================
+// tinyrenderer_bench: 微基准 + 整帧基准
+// 所有输入都由固定种子程序化生成，不依赖外部模型文件，结果可复现
+// 每项先预热若干次，再重复测量，报告中位数和分位数 (单位: 微秒/次)
+//
+// 用法: tinyrenderer_bench [--reps N] [--warmup N] [--threads N] [--filter 子串] [--json 文件]
+// ==========================================
+
+namespace {
+
+struct Options {
+	int reps = 30;
+	int warmup = 3;
+	int threads = 0;
+	std::string filter;
+	std::string json_path;
+};
+
+struct Result {
+	std::string name;
+	std::string unit;		//一次测量包含的工作量，比如 "10000 lines"
+	int reps = 0;
+	double min = 0, median = 0, p90 = 0, p99 = 0, max = 0, mean = 0;	//微秒
+};
+
+double percentile(const std::vector<double>& sorted, double p) {
+	if (sorted.empty()) return 0.0;
+	double pos = p * (sorted.size() - 1);
+	std::size_t lo = static_cast<std::size_t>(pos);
+	std::size_t hi = std::min(lo + 1, sorted.size() - 1);
+	return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+}
+
+class Runner {
+public:
+	explicit Runner(const Options& options) : options(options) {}
+
+	//fn 每调用一次算一次测量，每次之后重置 frame arena，与主循环的一帧相同
+	void run(const std::string& name, const std::string& unit, const std::function<void()>& fn) {
+		if (!options.filter.empty() && name.find(options.filter) == std::string::npos) return;
+
+		for (int i = 0; i < options.warmup; i++) {
+			fn();
+			FrameArena::end_frame();
+		}
+		std::vector<double> samples;
+		samples.reserve(options.reps);
+		for (int i = 0; i < options.reps; i++) {
+			auto start = std::chrono::steady_clock::now();
+			fn();
+			auto end = std::chrono::steady_clock::now();
+			FrameArena::end_frame();
+			samples.push_back(std::chrono::duration<double, std::micro>(end - start).count());
+		}
+		std::sort(samples.begin(), samples.end());
+
+		Result r;
+		r.name = name;
+		r.unit = unit;
+		r.reps = options.reps;
+		r.min = samples.front();
+		r.max = samples.back();
+		r.median = percentile(samples, 0.5);
+		r.p90 = percentile(samples, 0.9);
+		r.p99 = percentile(samples, 0.99);
+		for (double s : samples) r.mean += s;
+		r.mean /= samples.size();
+		results.push_back(r);
+
+		std::printf("%-40s %12.1f %12.1f %12.1f   (%s)\n", name.c_str(), r.median, r.p90, r.min, unit.c_str());
+		std::fflush(stdout);
+	}
+
+	void write_json(std::ostream& out) const {
+		out << "{\n  \"threads\": " << JobSystem::instance().nthreads()
+			<< ",\n  \"warmup\": " << options.warmup
+			<< ",\n  \"reps\": " << options.reps
+			<< ",\n  \"unit\": \"us\",\n  \"results\": [\n";
+		for (std::size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			out << "    {\"name\": \"" << r.name << "\", \"work\": \"" << r.unit << "\", \"reps\": " << r.reps
+				<< ", \"min\": " << r.min << ", \"median\": " << r.median << ", \"p90\": " << r.p90
+				<< ", \"p99\": " << r.p99 << ", \"max\": " << r.max << ", \"mean\": " << r.mean << "}"
+				<< (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		out << "  ]\n}\n";
+	}
+
+private:
+	Options options;
+	std::vector<Result> results;
+};
+
+// ------------------------------------------
+// 程序化网格，输出 OBJ 文本，坐标都在 [-1,1] 内
+// ------------------------------------------
+
+//经纬球: 三角形大小基本均匀，细分越多三角形越小
+std::string make_sphere(int rings, int segments, float radius) {
+	std::ostringstream obj;
+	const float pi = 3.14159265f;
+	for (int r = 0; r <= rings; r++) {
+		float theta = pi * r / rings;
+		for (int s = 0; s < segments; s++) {
+			float phi = 2.0f * pi * s / segments;
+			obj << "v " << radius * std::sin(theta) * std::cos(phi) << ' ' << radius * std::cos(theta) << ' '
+				<< radius * std::sin(theta) * std::sin(phi) << '\n';
+		}
+	}
+	for (int r = 0; r < rings; r++) {
+		for (int s = 0; s < segments; s++) {
+			int a = r * segments + s + 1;
+			int b = r * segments + (s + 1) % segments + 1;
+			int c = a + segments;
+			int d = b + segments;
+			obj << "f " << a << ' ' << c << ' ' << b << '\n';
+			obj << "f " << b << ' ' << c << ' ' << d << '\n';
+		}
+	}
+	return obj.str();
+}
+
+//一串沿z轴错开的同样大小的球，从后往前排，屏幕中央每个像素被覆盖好几层，用来比较前向和可见性缓冲的着色量
+std::string make_layered_spheres(int layers, int rings, int segments, float radius) {
+	std::ostringstream obj;
+	const float pi = 3.14159265f;
+	for (int l = 0; l < layers; l++) {
+		float cx = -0.1f + 0.03f * l, cz = -0.8f + 0.2f * l;
+		for (int r = 0; r <= rings; r++) {
+			float theta = pi * r / rings;
+			for (int s = 0; s < segments; s++) {
+				float phi = 2.0f * pi * s / segments;
+				obj << "v " << cx + radius * std::sin(theta) * std::cos(phi) << ' ' << radius * std::cos(theta) << ' '
+					<< cz + radius * std::sin(theta) * std::sin(phi) << '\n';
+			}
+		}
+	}
+	const int verts_per_layer = (rings + 1) * segments;
+	for (int l = 0; l < layers; l++) {
+		for (int r = 0; r < rings; r++) {
+			for (int s = 0; s < segments; s++) {
+				int a = l * verts_per_layer + r * segments + s + 1;
+				int b = l * verts_per_layer + r * segments + (s + 1) % segments + 1;
+				int c = a + segments;
+				int d = b + segments;
+				obj << "f " << a << ' ' << c << ' ' << b << '\n';
+				obj << "f " << b << ' ' << c << ' ' << d << '\n';
+			}
+		}
+	}
+	return obj.str();
+}
+
+//随机三角形汤: 边长在 [min_size, max_size] 上按对数均匀分布，覆盖从亚像素到半屏的各种尺寸
+std::string make_soup(int count, float min_size, float max_size, unsigned seed) {
+	std::mt19937 rng(seed);
+	std::uniform_real_distribution<float> pos(-1.0f, 1.0f);
+	std::uniform_real_distribution<float> log_size(std::log(min_size), std::log(max_size));
+	std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+	std::ostringstream obj;
+	for (int i = 0; i < count; i++) {
+		float cx = pos(rng), cy = pos(rng), z = pos(rng);
+		float size = std::exp(log_size(rng));
+		float a0 = angle(rng);
+		//逆时针的三个顶点，保证正面朝向
+		for (int k = 0; k < 3; k++) {
+			float a = a0 + k * 2.0943951f;
+			obj << "v " << cx + size * std::cos(a) << ' ' << cy + size * std::sin(a) << ' ' << z << '\n';
+		}
+		obj << "f " << 3 * i + 1 << ' ' << 3 * i + 2 << ' ' << 3 * i + 3 << '\n';
+	}
+	return obj.str();
+}
+
+struct Mesh {
+	std::string name;
+	std::string path;
+	std::string text;
+};
+
+//实例化的对照: 把一个实例的变换放进顶点着色，逐个实例调用 draw_mesh，等价于把变换后的模型交给 draw_model
+struct InstanceShader {
+	static constexpr int varyings = 0;
+	static constexpr bool depth_test = false;
+	static constexpr bool color_write = true;
+	static constexpr bool blend = false;
+	static constexpr bool discard = false;
+	using Varying = Varyings<varyings>;
+
+	const Model* model;
+	const Mat4f* transform;
+	const TGAColor* colors;
+
+	Vec3f vertex(int iface, int nthvert, Varying&) const { return transform->transform_point(model->vert(iface, nthvert)); }
+	bool fragment(int iface, const Varying&, TGAColor& out) const { out = colors[iface]; return true; }
+};
+
+std::vector<Mesh> make_meshes() {
+	std::vector<Mesh> meshes = {
+		{ "sphere_micro", "", make_sphere(200, 400, 0.9f) },		//16万个亚像素到数像素的三角形
+		{ "sphere_small", "", make_sphere(100, 200, 0.9f) },
+		{ "soup_mixed", "", make_soup(20000, 0.002f, 0.1f, 1) },
+		{ "soup_large", "", make_soup(200, 0.2f, 0.8f, 2) },
+		{ "spheres_layered", "", make_layered_spheres(8, 48, 96, 0.5f) },	//8层重叠，用于可见性缓冲
+	};
+	std::filesystem::path dir = std::filesystem::temp_directory_path();
+	for (Mesh& mesh : meshes) {
+		mesh.path = (dir / ("tinyrenderer_bench_" + mesh.name + ".obj")).string();
+		std::ofstream out(mesh.path, std::ios::binary);
+		out << mesh.text;
+	}
+	return meshes;
+}
+
+}
+
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				std::cerr << "missing value for " << arg << std::endl;
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+		if (arg == "--reps") options.reps = std::max(1, std::atoi(value().c_str()));
+		else if (arg == "--warmup") options.warmup = std::max(0, std::atoi(value().c_str()));
+		else if (arg == "--threads") options.threads = std::atoi(value().c_str());
+		else if (arg == "--filter") options.filter = value();
+		else if (arg == "--json") options.json_path = value();
+		else {
+			std::cerr << "usage: " << argv[0] << " [--reps N] [--warmup N] [--threads N] [--filter NAME] [--json FILE]" << std::endl;
+			return 1;
+		}
+	}
+	if (options.threads > 0) JobSystem::configure(options.threads);
+
+	std::printf("threads %d, warmup %d, reps %d\n", JobSystem::instance().nthreads(), options.warmup, options.reps);
+	std::printf("%-40s %12s %12s %12s\n", "benchmark (us)", "median", "p90", "min");
+
+	Runner runner(options);
+	constexpr int width = 800, height = 800;
+	TGAImage framebuffer(width, height, TGAImage::RGB);
+	const TGAColor white = { 255, 255, 255, 255 };
+
+	// ---------- draw_line ----------
+	{
+		std::mt19937 rng(42);
+		std::uniform_int_distribution<int> on_screen(0, width - 1);
+		std::uniform_int_distribution<int> off_screen(-width, 2 * width);
+		std::uniform_int_distribution<int> short_delta(-8, 8);
+		constexpr int N = 10000;
+		std::vector<Vec2i> short_lines, long_lines, clipped_lines;
+		for (int i = 0; i < N; i++) {
+			Vec2i p(on_screen(rng), on_screen(rng));
+			short_lines.push_back(p);
+			short_lines.push_back(Vec2i(p.x + short_delta(rng), p.y + short_delta(rng)));
+			long_lines.push_back(Vec2i(on_screen(rng), on_screen(rng)));
+			long_lines.push_back(Vec2i(on_screen(rng), on_screen(rng)));
+			clipped_lines.push_back(Vec2i(off_screen(rng), off_screen(rng)));
+			clipped_lines.push_back(Vec2i(off_screen(rng), off_screen(rng)));
+		}
+		auto serial = [&](const std::vector<Vec2i>& lines) {
+			return [&] {
+				for (std::size_t i = 0; i < lines.size(); i += 2)
+					draw_line(lines[i].x, lines[i].y, lines[i + 1].x, lines[i + 1].y, framebuffer, white);
+			};
+		};
+		runner.run("draw_line/short", "10000 lines", serial(short_lines));
+		runner.run("draw_line/long", "10000 lines", serial(long_lines));
+		runner.run("draw_line/offscreen", "10000 lines", serial(clipped_lines));
+		runner.run("draw_lines/long", "10000 lines", [&] { draw_lines(long_lines, framebuffer, white); });
+	}
+
+	// ---------- triangle ----------
+	{
+		std::mt19937 rng(7);
+		std::uniform_int_distribution<int> on_screen(0, width - 1);
+		auto make = [&](int size, int count) {
+			std::uniform_int_distribution<int> delta(-size, size);
+			std::vector<Vec2i> tris;
+			while (static_cast<int>(tris.size()) < 3 * count) {
+				Vec2i a(on_screen(rng), on_screen(rng));
+				Vec2i b(a.x + delta(rng), a.y + delta(rng));
+				Vec2i c(a.x + delta(rng), a.y + delta(rng));
+				if (signed_area2(a.x, a.y, b.x, b.y, c.x, c.y) < 0) std::swap(b, c);
+				tris.push_back(a);
+				tris.push_back(b);
+				tris.push_back(c);
+			}
+			return tris;
+		};
+		std::vector<Vec2i> micro = make(2, 10000), small = make(16, 10000), large = make(200, 200);
+		auto fill = [&](const std::vector<Vec2i>& tris) {
+			return [&] {
+				for (std::size_t i = 0; i < tris.size(); i += 3)
+					triangle(tris[i].x, tris[i].y, tris[i + 1].x, tris[i + 1].y, tris[i + 2].x, tris[i + 2].y, framebuffer, white);
+			};
+		};
+		runner.run("triangle/micro", "10000 triangles", fill(micro));
+		runner.run("triangle/small", "10000 triangles", fill(small));
+		runner.run("triangle/large", "200 triangles", fill(large));
+	}
+
+	// ---------- OBJ 解析 ----------
+	std::vector<Mesh> meshes = make_meshes();
+	for (const Mesh& mesh : meshes) {
+		std::string work = std::to_string(mesh.text.size() / 1024) + " KiB";
+		runner.run("obj_parse/" + mesh.name, work, [&] { Model model(mesh.path); });
+	}
+
+	// ---------- 整帧 ----------
+	std::vector<Model> models;
+	models.reserve(meshes.size());
+	for (const Mesh& mesh : meshes) models.emplace_back(mesh.path);
+	for (std::size_t m = 0; m < meshes.size(); m++) {
+		const Model& model = models[m];
+		std::vector<TGAColor> colors(model.nfaces());
+		for (int i = 0; i < model.nfaces(); i++) colors[i] = face_color(i);
+		std::vector<TGAColor> vertex_colors(model.nverts());
+		for (int i = 0; i < model.nverts(); i++) {
+			Vec3f v = model.vert(i);
+			vertex_colors[i] = { static_cast<std::uint8_t>((v.x + 1) * 127), static_cast<std::uint8_t>((v.y + 1) * 127),
+				static_cast<std::uint8_t>((v.z + 1) * 127), 255 };
+		}
+		std::vector<float> depth(width * height);
+		std::string work = std::to_string(model.nfaces()) + " faces";
+
+		runner.run("frame_flat/" + meshes[m].name, work, [&] {
+			framebuffer.clear();
+			draw_model(model, framebuffer, colors);
+		});
+		runner.run("frame_gouraud/" + meshes[m].name, work, [&] {
+			framebuffer.clear();
+			std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::lowest());
+			RenderTarget target;
+			target.color = &framebuffer;
+			target.depth = depth.data();
+			draw_mesh(model, GouraudShader{ &model, vertex_colors.data() }, target);
+		});
+	}
+
+	// ---------- 可见性缓冲 vs 前向着色 ----------
+	{
+		std::size_t m = std::find_if(meshes.begin(), meshes.end(), [](const Mesh& mesh) { return mesh.name == "spheres_layered"; }) - meshes.begin();
+		const Model& model = models[m];
+		std::vector<TGAColor> vertex_colors(model.nverts());
+		for (int i = 0; i < model.nverts(); i++) {
+			Vec3f v = model.vert(i);
+			vertex_colors[i] = { static_cast<std::uint8_t>((v.x + 1) * 127), static_cast<std::uint8_t>((v.y + 1) * 127),
+				static_cast<std::uint8_t>((v.z + 1) * 127), 255 };
+		}
+		GouraudShader shader{ &model, vertex_colors.data() };
+		std::vector<float> depth(width * height);
+		VisibilityBuffer vb(width, height);
+		std::string work = std::to_string(model.nfaces()) + " faces";
+		//每次测量的片元着色调用次数；两种方式各画到自己的图像里，最后逐像素比较
+		std::atomic<long long> forward_shaded(0), visibility_shaded(0);
+		TGAImage forward_image(width, height, TGAImage::RGB), visibility_image(width, height, TGAImage::RGB);
+
+		runner.run("shading_forward/spheres_layered", work, [&] {
+			forward_shaded = 0;
+			forward_image.clear();
+			std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::lowest());
+			RenderTarget target;
+			target.color = &forward_image;
+			target.depth = depth.data();
+			draw_mesh(model, CountingShader<GouraudShader>{ &shader, &forward_shaded }, target);
+		});
+		runner.run("shading_visibility/spheres_layered", work, [&] {
+			visibility_shaded = 0;
+			visibility_image.clear();
+			CountingShader<GouraudShader> counting{ &shader, &visibility_shaded };
+			render_visibility(model, counting, vb);
+			resolve_visibility(counting, vb, visibility_image);
+		});
+		if (forward_shaded > 0 && visibility_shaded > 0) {
+			int mismatched = 0;
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++) {
+					TGAColor a = forward_image.get(x, y), b = visibility_image.get(x, y);
+					mismatched += a[0] != b[0] || a[1] != b[1] || a[2] != b[2];
+				}
+			std::printf("  (fragments shaded: forward %lld, visibility %lld, %.2fx; mismatched pixels %d)\n", forward_shaded.load(),
+				visibility_shaded.load(), static_cast<double>(forward_shaded) / visibility_shaded, mismatched);
+			if (mismatched > 0) {
+				std::cerr << "visibility buffer image differs from forward rendering" << std::endl;
+				for (const Mesh& mesh : meshes) std::filesystem::remove(mesh.path);
+				return 1;
+			}
+		}
+	}
+
+	// ---------- 实例化: 互相重叠的实例 ----------
+	{
+		std::size_t m = std::find_if(meshes.begin(), meshes.end(), [](const Mesh& mesh) { return mesh.name == "sphere_small"; }) - meshes.begin();
+		const Model& model = models[m];
+		std::vector<TGAColor> colors(model.nfaces());
+		for (int i = 0; i < model.nfaces(); i++) colors[i] = face_color(i);
+		//两批多的实例挤在屏幕中间，大量互相遮挡，最终像素取决于绘制顺序
+		std::mt19937 rng(11);
+		std::uniform_real_distribution<float> pos(-0.5f, 0.5f);
+		std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+		std::vector<Mat4f> transforms;
+		for (int i = 0; i < 2 * INSTANCE_BATCH + 7; i++)
+			transforms.push_back(Mat4f::Translation(Vec3f(pos(rng), pos(rng), 0)) * Mat4f::RotationY(angle(rng)) * Mat4f::Scale(Vec3f(0.3f, 0.3f, 0.3f)));
+		std::string work = std::to_string(transforms.size()) + " x " + std::to_string(model.nfaces()) + " faces";
+
+		TGAImage instanced_image(width, height, TGAImage::RGB), reference_image(width, height, TGAImage::RGB);
+		bool instanced_ran = false, reference_ran = false;
+		runner.run("instancing/overlapping", work, [&] {
+			instanced_image.clear();
+			draw_instanced(model, transforms, instanced_image, colors);
+			instanced_ran = true;
+		});
+		runner.run("instancing/per_instance_loop", work, [&] {
+			reference_image.clear();
+			RenderTarget target;
+			target.color = &reference_image;
+			for (const Mat4f& transform : transforms) draw_mesh(model, InstanceShader{ &model, &transform, colors.data() }, target);
+			reference_ran = true;
+		});
+		if (instanced_ran && reference_ran) {
+			int mismatched = 0;
+			for (int y = 0; y < height; y++)
+				for (int x = 0; x < width; x++) {
+					TGAColor a = instanced_image.get(x, y), b = reference_image.get(x, y);
+					mismatched += a[0] != b[0] || a[1] != b[1] || a[2] != b[2];
+				}
+			std::printf("  (instancing vs per-instance loop: mismatched pixels %d)\n", mismatched);
+			if (mismatched > 0) {
+				std::cerr << "draw_instanced differs from drawing the instances one by one" << std::endl;
+				for (const Mesh& mesh : meshes) std::filesystem::remove(mesh.path);
+				return 1;
+			}
+		}
+	}
+
+	// ---------- write_tga_file (RLE) ----------
+	{
+		std::vector<TGAColor> colors(models[0].nfaces());
+		for (int i = 0; i < models[0].nfaces(); i++) colors[i] = face_color(i);
+		TGAImage busy(width, height, TGAImage::RGB), flat(width, height, TGAImage::RGB);
+		draw_model(models[0], busy, colors);
+		for (int i = 0; i < 50; i++) triangle(100 + i * 10, 100, 700, 100 + i * 5, 400, 700, flat, white);
+		std::string path = (std::filesystem::temp_directory_path() / "tinyrenderer_bench.tga").string();
+		runner.run("write_tga_rle/busy", "800x800 RGB", [&] { busy.write_tga_file(path); });
+		runner.run("write_tga_rle/flat", "800x800 RGB", [&] { flat.write_tga_file(path); });
+		runner.run("write_tga_raw/busy", "800x800 RGB", [&] { busy.write_tga_file(path, true, false); });
+		std::filesystem::remove(path);
+	}
+
+	// ---------- OBB2D ----------
+	{
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> pos(-100.0f, 100.0f);
+		std::uniform_real_distribution<float> spread(1.0f, 20.0f);
+		std::uniform_real_distribution<float> angle(0.0f, 6.2831853f);
+		constexpr int N = 1000;
+		std::vector<std::vector<Vec2f>> clouds(N);
+		for (auto& cloud : clouds) {
+			float cx = pos(rng), cy = pos(rng), sx = spread(rng), sy = spread(rng), a = angle(rng);
+			for (int k = 0; k < 32; k++) {
+				float u = pos(rng) / 100.0f * sx, v = pos(rng) / 100.0f * sy;
+				cloud.push_back(Vec2f(cx + u * std::cos(a) - v * std::sin(a), cy + u * std::sin(a) + v * std::cos(a)));
+			}
+		}
+		std::vector<OBB2D> boxes(N);
+		runner.run("obb2d/build_pca", "1000 boxes x 32 points", [&] {
+			for (int i = 0; i < N; i++) boxes[i] = OBB2D(clouds[i]);
+		});
+		int hits = 0;
+		runner.run("obb2d/intersects", "1000x1000 pairs", [&] {
+			int count = 0;
+			for (int i = 0; i < N; i++)
+				for (int j = 0; j < N; j++) count += boxes[i].Intersects(boxes[j]);
+			hits = count;
+		});
+		if (hits > 0) std::printf("  (obb2d hits: %d)\n", hits);
+	}
+
+	for (const Mesh& mesh : meshes) std::filesystem::remove(mesh.path);
+
+	if (!options.json_path.empty()) {
+		std::ofstream out(options.json_path);
+		runner.write_json(out);
+		std::printf("wrote %s\n", options.json_path.c_str());
+	}
+	return 0;
+}
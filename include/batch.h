@@ -0,0 +1,32 @@
+#pragma once
+#include <vector>
+#include "vector.h"
+#include "model.h"
+#include "tgaimage.h"
+
+// 一个视角: 模型空间到归一化设备坐标 [-1,1] 的变换 + 输出分辨率
+struct View {
+	Mat4f transform;
+	int width = 800;
+	int height = 800;
+};
+
+// ==========================================
+// BatchRenderer: 同一个模型的多视角批量渲染
+// 以帧为并行粒度，每个 view 独占一个任务和一块 framebuffer，
+// 追求的是总吞吐 (帧/秒) 而不是单帧延迟
+// 模型和每面颜色只读共享，投影用的临时数组从执行线程的 frame arena 分配
+// ==========================================
+class BatchRenderer {
+public:
+	explicit BatchRenderer(const Model& model);
+
+	//把 views[i] 渲染到 framebuffers[i]；尺寸相同的 framebuffer 清屏复用，否则重新分配
+	void render(const std::vector<View>& views, std::vector<TGAImage>& framebuffers);
+
+private:
+	void render_view(const View& view, TGAImage& framebuffer) const;
+
+	const Model& model;
+	std::vector<TGAColor> colors;
+};
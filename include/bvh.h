@@ -0,0 +1,78 @@
+#pragma once
+#include <atomic>
+#include <vector>
+#include "vector.h"
+#include "OBB2D.h"
+#include "model.h"
+
+// ==========================================
+// AABB2D: 屏幕空间轴对齐包围盒
+// ==========================================
+struct AABB2D {
+	Vec2f min, max;
+
+	//默认构造为空盒 (min > max)，expand 之后才有效
+	AABB2D();
+	AABB2D(const Vec2f& min_, const Vec2f& max_);
+
+	void expand(const Vec2f& p);
+	void expand(const AABB2D& other);
+
+	bool empty() const;
+	//半周长，二维下SAH用它代替表面积
+	float half_perimeter() const;
+	Vec2f center() const;
+
+	bool containsPoint(const Vec2f& p) const;
+	bool overlaps(const AABB2D& other) const;
+
+	OBB2D toOBB() const;
+};
+
+// ==========================================
+// ScreenBVH: 投影后三角形的层次包围盒
+// 用于拾取 (哪个三角形覆盖像素(x,y)) 和区域查询 (哪些面碰到这个矩形/OBB)
+// 三角形顶点与 triangle() 使用同样的 project() 整数坐标，拾取结果与光栅化完全一致
+// ==========================================
+class ScreenBVH {
+public:
+	struct Node {
+		AABB2D box;
+		int first;		//叶子: 第一个图元在 prims 中的下标; 内部节点: 左孩子下标 (右孩子 = first + 1)
+		int count;		//叶子: 图元数量; 内部节点: 0
+		bool leaf() const { return count > 0; }
+	};
+
+	//投影模型所有面并用分箱SAH建树，大的子树并行构建
+	void build(const Model& model, int width, int height);
+
+	//拓扑不变、顶点移动后原地更新包围盒，不重新划分
+	void refit(const Model& model, int width, int height);
+
+	//返回覆盖像素(x,y)的面索引，多个面覆盖时返回最后绘制的那个(面索引最大)，没有则返回 -1
+	int pick(int x, int y) const;
+
+	//所有与像素矩形 [x0,x1]x[y0,y1] 相交的面，结果按面索引升序
+	void query_rect(int x0, int y0, int x1, int y1, std::vector<int>& out) const;
+
+	//所有与 OBB 相交的面，结果按面索引升序
+	void query_obb(const OBB2D& box, std::vector<int>& out) const;
+
+	int nnodes() const { return static_cast<int>(nodes.size()); }
+	int nprims() const { return static_cast<int>(prims.size()); }
+	const std::vector<Node>& get_nodes() const { return nodes; }
+
+private:
+	void project_verts(const Model& model, int width, int height);
+	AABB2D face_box(int iface) const;
+	void triangle_corners(int iface, Vec2f out[3]) const;
+	void build_node(int inode, int first, int count, int depth);
+	void refit_leaf(Node& node) const;
+
+	std::vector<Vec2i> screen_verts;		//每个顶点的屏幕坐标
+	std::vector<int> face_verts;			//每个面的三个顶点索引 (拍平)
+	std::vector<AABB2D> prim_boxes;			//仅建树时使用
+	std::vector<int> prims;					//叶子引用的面索引，按叶子顺序排列
+	std::vector<Node> nodes;
+	std::atomic<int> node_count{ 0 };
+};
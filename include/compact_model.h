@@ -0,0 +1,96 @@
+#pragma once
+#include <cstdint>
+#include <span>
+#include <vector>
+#include "vector.h"
+#include "model.h"
+#include "frame_arena.h"
+
+// ==========================================
+// CompactModel: Model 的量化紧凑存储，只读，接口与 Model 相同，可以直接交给 draw_mesh 和各着色器
+//   位置: 每轴 16 位定点数，相对模型包围盒，按结构数组 (x[]、y[]、z[]) 存放，批量反量化可以被编译器向量化
+//   索引: 每 MESHLET_FACES 个面一个 meshlet，存一个32位基准索引，面的索引存成相对基准的16位偏移；
+//         偏移放不下的 meshlet 退回32位
+//   法线: 由相邻面法线平均得到的顶点法线，八面体映射编码成两个16位数
+// 不长期保留解压后的副本: draw_model 在顶点阶段之前用 dequantize() 按块批量反量化到 frame arena (DequantizedMesh)，
+// 直接交给着色器时则由 vert() 逐个反量化
+// ==========================================
+
+constexpr int MESHLET_FACES = 256;
+
+//量化带来的误差
+struct QuantizationReport {
+	std::size_t source_bytes = 0;		//原 Model 的顶点位置和面索引 (Model::geometry_bytes，估算)
+	std::size_t source_edge_bytes = 0;	//原 Model 的边表 (Model::edge_bytes，没建时为 0)；CompactModel 没有对应部分，不画描边/线框，不参与比较
+	std::size_t compact_bytes = 0;		//量化后的位置、索引和编码法线 (CompactModel::memory_bytes)，与 source_bytes 比较
+	float max_position_error = 0.0f;	//模型空间中任一轴的最大误差
+	float max_error_pixels = 0.0f;		//投影到屏幕后的最大偏移 (像素，取整之前)
+	int moved_vertices = 0;				//取整后屏幕坐标发生变化的顶点数
+	float max_normal_error_deg = 0.0f;	//法线解码后的最大角度误差
+};
+
+class CompactModel {
+public:
+	explicit CompactModel(const Model& model);
+
+	int nverts() const { return static_cast<int>(qx.size()); }
+	int nfaces() const { return num_faces; }
+
+	Vec3f vert(const int i) const {
+		return Vec3f(offset.x + qx[i] * scale.x, offset.y + qy[i] * scale.y, offset.z + qz[i] * scale.z);
+	}
+	Vec3f vert(const int iface, const int nthvert) const { return vert(vert_idx(iface, nthvert)); }
+	int vert_idx(const int iface, const int jvert) const {
+		const Meshlet& meshlet = meshlets[iface / MESHLET_FACES];
+		int k = 3 * (iface % MESHLET_FACES) + jvert;
+		return meshlet.wide ? wide_indices[meshlet.start + k] : meshlet.base + local_indices[meshlet.start + k];
+	}
+	Vec3f normal(const int i) const;		//解码后的单位顶点法线
+	Vec3f bbox_min() const { return bmin; }
+	Vec3f bbox_max() const { return bmax; }
+
+	//批量反量化 [first, last) 的顶点位置到 out
+	void dequantize(int first, int last, Vec3f* out) const;
+
+	//实际占用的字节数
+	std::size_t memory_bytes() const;
+
+	//与原模型比较误差; transform 与 View::transform 相同，width/height 是输出分辨率
+	QuantizationReport measure_error(const Model& source, const Mat4f& transform, int width, int height) const;
+
+private:
+	struct Meshlet {
+		int base;		//本 meshlet 所有索引的最小值
+		int start;		//第一个索引在 local_indices (或 wide_indices) 里的位置
+		bool wide;		//偏移放不下16位，索引存在 wide_indices 里
+	};
+
+	int num_faces = 0;
+	Vec3f bmin, bmax;
+	Vec3f offset, scale;		//v = offset + q * scale
+	std::vector<std::uint16_t> qx, qy, qz;
+	std::vector<std::int16_t> normals;		//每顶点两个，八面体编码
+	std::vector<Meshlet> meshlets;
+	std::vector<std::uint16_t> local_indices;	//16位 meshlet 的索引，每面三个，相对 meshlet 基准
+	std::vector<int> wide_indices;				//32位 meshlet 的索引，每面三个
+};
+
+//在 arena 里批量反量化出所有顶点位置，接口与 CompactModel 相同，可以直接交给 draw_mesh 和各着色器
+//顶点阶段每个角只读一个 Vec3f；索引和法线仍从量化模型读。只在分配它的 ArenaScope 内有效
+class DequantizedMesh {
+public:
+	DequantizedMesh(const CompactModel& model, FrameArena& arena);
+
+	int nverts() const { return static_cast<int>(positions.size()); }
+	int nfaces() const { return source->nfaces(); }
+	Vec3f vert(const int i) const { return positions[i]; }
+	Vec3f vert(const int iface, const int nthvert) const { return positions[source->vert_idx(iface, nthvert)]; }
+	int vert_idx(const int iface, const int jvert) const { return source->vert_idx(iface, jvert); }
+	Vec3f normal(const int i) const { return source->normal(i); }
+	Vec3f bbox_min() const { return source->bbox_min(); }
+	Vec3f bbox_max() const { return source->bbox_max(); }
+
+private:
+	const CompactModel* source;
+	std::span<Vec3f> positions;
+};
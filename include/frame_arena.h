@@ -0,0 +1,91 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <span>
+#include <type_traits>
+#include <vector>
+
+// ==========================================
+// FrameArena: 每线程一个线性 (bump) 分配器，给管线各阶段的临时数组用
+// 分配只是移动指针，不逐个释放:
+//   ArenaScope 结束时回退到进入时的位置，同一帧里后面的阶段接着复用这段内存
+//   FrameArena::end_frame() 在帧结束时把所有线程的 arena 归零，并记录本帧的峰值用量
+// 容量不够时追加新块，帧结束时合并成一整块，所以稳定后的帧不再调用 malloc
+// 只能放平凡析构的类型，内存不会初始化
+// ==========================================
+
+struct ArenaStats {
+	std::size_t frame_peak = 0;			//上一帧所有线程峰值用量之和 (字节)
+	std::size_t max_frame_peak = 0;		//历史上最大的 frame_peak
+	long long block_allocations = 0;	//累计向系统申请内存块的次数，稳定后不再增长
+};
+
+class FrameArena {
+public:
+	FrameArena();
+	~FrameArena();
+	FrameArena(const FrameArena&) = delete;
+	FrameArena& operator=(const FrameArena&) = delete;
+
+	//当前线程的 arena，第一次使用时创建
+	static FrameArena& local();
+
+	//帧结束时调用: 记录峰值并把所有线程的 arena 归零，之前分配的数组全部失效
+	//只能在没有任务运行时调用
+	static void end_frame();
+	static ArenaStats stats();
+
+	void* allocate(std::size_t bytes, std::size_t align);
+
+	template<class T>
+	std::span<T> alloc(std::size_t n) {
+		static_assert(std::is_trivially_destructible_v<T>, "arena memory is never destructed");
+		return std::span<T>(static_cast<T*>(allocate(n * sizeof(T), alignof(T))), n);
+	}
+
+	//同 alloc，并把每个元素置为 value
+	template<class T>
+	std::span<T> alloc_filled(std::size_t n, const T& value) {
+		std::span<T> out = alloc<T>(n);
+		for (T& x : out) x = value;
+		return out;
+	}
+
+	struct Mark {
+		std::size_t block;
+		std::size_t offset;
+	};
+	Mark mark() const { return { current, offset }; }
+	void rewind(const Mark& m) { current = m.block; offset = m.offset; }
+
+private:
+	struct Block {
+		std::unique_ptr<std::byte[]> data;
+		std::size_t size = 0;
+		std::size_t base = 0;		//之前所有块的大小之和，用来算用量
+	};
+
+	void add_block(std::size_t min_size);
+	void reset();
+
+	std::vector<Block> blocks;
+	std::size_t current = 0;
+	std::size_t offset = 0;
+	std::size_t peak = 0;
+};
+
+//作用域内从当前线程 arena 分配的内存在离开作用域时一起释放
+class ArenaScope {
+public:
+	ArenaScope() : arena(FrameArena::local()), saved(arena.mark()) {}
+	~ArenaScope() { arena.rewind(saved); }
+	ArenaScope(const ArenaScope&) = delete;
+	ArenaScope& operator=(const ArenaScope&) = delete;
+
+	FrameArena& operator*() const { return arena; }
+	FrameArena* operator->() const { return &arena; }
+
+private:
+	FrameArena& arena;
+	FrameArena::Mark saved;
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <span>
+#include <vector>
+#include "vector.h"
+#include "model.h"
+#include "tgaimage.h"
+
+// ==========================================
+// IncrementalRenderer: 基于脏tile的增量重绘
+// 记录每个对象上一帧覆盖了哪些屏幕tile (RASTER_TILE_SIZE)，
+// 对象被标记改变后，只清空并重画它新旧覆盖范围的并集，其余tile直接沿用上一帧的像素
+// 所有对象按加入顺序、面按面序绘制，结果与整帧重画逐字节相同
+// 每个对象的覆盖表是跨帧复用的扁平数组，render() 里的临时表从当前线程的 FrameArena 分配
+// ==========================================
+class IncrementalRenderer {
+public:
+	struct Stats {
+		int tiles_total = 0;
+		int tiles_redrawn = 0;
+		float reused_fraction = 0.0f;	//本帧直接沿用的tile占比
+	};
+
+	IncrementalRenderer(int width, int height);
+
+	//加入一个对象，返回对象编号；模型由调用者保证在渲染器之前一直存活
+	int add(const Model& model, const Mat4f& transform);
+	//修改变换，同时标记为已改变
+	void set_transform(int id, const Mat4f& transform);
+	//模型顶点等内容变化后由调用者标记
+	void mark_dirty(int id);
+
+	//只重画脏tile，返回结果图像
+	const TGAImage& render();
+
+	const TGAImage& image() const { return framebuffer; }
+	const Stats& stats() const { return last_stats; }
+
+private:
+	struct Object {
+		const Model* model;
+		Mat4f transform;
+		bool dirty = true;
+		std::vector<Vec2i> screen_coords;
+		//覆盖tile t的面是 faces[tile_start[t], tile_start[t+1])，按面序排列，区间为空表示不覆盖
+		std::vector<int> tile_start;
+		std::vector<int> faces;
+	};
+
+	void rebin(Object& object, std::span<char> dirty_tiles) const;
+	void redraw_tile(int tile);
+
+	int width, height;
+	int tiles_x, tiles_y;
+	TGAImage framebuffer;
+	std::vector<Object> objects;
+	std::vector<TGAColor> colors;		//face_color 缓存，按最大面数增长
+	Stats last_stats;
+};
@@ -0,0 +1,23 @@
+#pragma once
+#include <span>
+#include <vector>
+#include "vector.h"
+#include "model.h"
+#include "tgaimage.h"
+
+constexpr int INSTANCE_BATCH = 64;		//一批同时变换/分箱的实例数，限制变换后顶点缓冲的大小
+
+struct InstanceStats {
+	int submitted = 0;		//提交的实例数
+	int culled = 0;			//包围盒完全在屏幕外被剔除的实例数
+	int batches = 0;		//实际处理的批次数
+};
+
+// 用每个实例自己的变换把同一个模型画很多份，colors[i] 是第i个面的颜色
+// 1. 先把模型包围盒的8个角变换到NDC，整体在屏幕外的实例直接剔除
+// 2. 剩下的实例按 INSTANCE_BATCH 一批: 批内所有实例的顶点一起变换，
+//    然后每个面为批内的每个实例各生成一个三角形并分箱，模型的索引在开始时只读一次
+// 临时数组都从当前线程的 FrameArena 分配
+// 绘制顺序: 按实例顺序，实例内按面序，结果与对每个实例依次做一遍 draw_model 相同
+InstanceStats draw_instanced(const Model& model, std::span<const Mat4f> transforms, TGAImage& framebuffer,
+	const std::vector<TGAColor>& colors);
@@ -0,0 +1,160 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// ==========================================
+// JobSystem: 固定线程池 + 每线程一个可窃取的任务队列
+// 调用 parallel_for / TaskGraph::run 的线程自己也参与干活 (线程号 0)，
+// 所以等待期间不会空转，嵌套并行也不会死锁
+// ==========================================
+class JobSystem {
+public:
+	struct Job {
+		void (*fn)(const void* ctx, int lo, int hi) = nullptr;
+		const void* ctx = nullptr;
+		int lo = 0, hi = 0;
+		std::atomic<int>* counter = nullptr;	//执行完后减一，等待者据此判断完成
+	};
+
+	//num_threads <= 0 时使用调用线程允许的全部CPU (allowed_cpus)
+	//pin_threads 把第 i 个线程 (包括线程号为 0 的调用线程) 绑到 allowed_cpus() 的第 i % CPU数 个CPU上 (仅Linux)，
+	//调用线程原来的亲和性在析构时恢复
+	explicit JobSystem(int num_threads = 0, bool pin_threads = false);
+	~JobSystem();
+	JobSystem(const JobSystem&) = delete;
+	JobSystem& operator=(const JobSystem&) = delete;
+
+	//包括调用线程在内的总线程数
+	int nthreads() const { return static_cast<int>(queues.size()); }
+
+	//当前线程在池中的编号，调用线程(以及池外线程)为 0，工作线程为 1..nthreads()-1
+	//只用来选择任务队列: 多个池外线程同时提交时共用 0 号队列 (有锁)，不能当作每线程唯一的下标
+	static int thread_index();
+
+	//全局实例，第一次使用时按硬件线程数创建
+	static JobSystem& instance();
+	//重新创建全局实例，只能在没有任务运行时调用
+	static void configure(int num_threads, bool pin_threads = false);
+	//fork 出的子进程里调用: 子进程只有调用 fork 的那个线程，旧实例的工作线程不存在，不能 join 也不能析构，
+	//直接丢弃后按新的线程数重建；新线程继承调用线程的 CPU 亲和性
+	static void reinit_after_fork(int num_threads, bool pin_threads = false);
+
+	void submit(const Job& job);
+
+	//一边执行队列里的任务一边等待，直到 counter 归零
+	void wait(const std::atomic<int>& counter);
+
+	//把 [begin, end) 按 grain 切块并行执行 fn(lo, hi)，grain <= 0 时自动选择块大小
+	template<class F>
+	void parallel_for(int begin, int end, int grain, const F& fn);
+
+private:
+	//环形缓冲的双端队列，容量只增不减，稳定后提交任务不再分配内存 (std::deque 会反复申请/释放节点)
+	struct Queue {
+		std::mutex mutex;
+		std::vector<Job> ring = std::vector<Job>(64);
+		std::size_t head = 0, count = 0;
+
+		bool empty() const { return count == 0; }
+		void push_back(const Job& job) {
+			if (count == ring.size()) {
+				std::vector<Job> bigger(ring.size() * 2);
+				for (std::size_t i = 0; i < count; i++) bigger[i] = ring[(head + i) % ring.size()];
+				ring.swap(bigger);
+				head = 0;
+			}
+			ring[(head + count++) % ring.size()] = job;
+		}
+		Job pop_back() { return ring[(head + --count) % ring.size()]; }
+		Job pop_front() {
+			Job job = ring[head];
+			head = (head + 1) % ring.size();
+			count--;
+			return job;
+		}
+	};
+
+	bool try_pop(int index, Job& job);
+	bool try_steal(int thief, Job& job);
+	void run(const Job& job);
+	void worker_loop(int index);
+
+	void restore_caller_affinity();
+
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	std::vector<int> caller_cpus;		//pin_threads 时调用线程原来允许的CPU
+	std::thread::id pinned_caller;
+	std::atomic<int> queued{ 0 };		//所有队列里的任务总数
+	std::atomic<int> sleeping{ 0 };
+	std::atomic<bool> stopping{ false };
+	std::mutex sleep_mutex;
+	std::condition_variable sleep_cv;
+};
+
+//当前线程允许运行的CPU (sched_getaffinity)，取不到时为 0..hardware_concurrency-1
+std::vector<int> allowed_cpus();
+
+template<class F>
+void JobSystem::parallel_for(int begin, int end, int grain, const F& fn) {
+	int n = end - begin;
+	if (n <= 0) return;
+	if (grain <= 0) grain = std::max(1, n / (nthreads() * 4));
+	if (nthreads() == 1 || n <= grain) {
+		fn(begin, end);
+		return;
+	}
+
+	int nchunks = (n + grain - 1) / grain;
+	std::atomic<int> counter(nchunks);
+	auto trampoline = [](const void* ctx, int lo, int hi) { (*static_cast<const F*>(ctx))(lo, hi); };
+	//第一块留给自己执行，其余的丢进队列
+	for (int c = 1; c < nchunks; c++) {
+		Job job;
+		job.fn = trampoline;
+		job.ctx = &fn;
+		job.lo = begin + c * grain;
+		job.hi = std::min(end, job.lo + grain);
+		job.counter = &counter;
+		submit(job);
+	}
+	fn(begin, std::min(end, begin + grain));
+	counter.fetch_sub(1, std::memory_order_acq_rel);
+	wait(counter);
+}
+
+// ==========================================
+// TaskGraph: 依赖计数的任务图
+// 每个任务等它的所有前驱完成后才会被提交
+// ==========================================
+class TaskGraph {
+public:
+	int add(std::function<void()> fn);
+	//a 完成之后才能开始 b
+	void precede(int a, int b);
+	//执行整张图并等待全部完成，可以重复执行
+	void run(JobSystem& jobs = JobSystem::instance());
+
+	int ntasks() const { return static_cast<int>(tasks.size()); }
+
+private:
+	struct Task {
+		std::function<void()> fn;
+		std::vector<int> successors;
+		int num_predecessors = 0;
+		std::atomic<int> pending{ 0 };
+	};
+
+	static void execute(const void* ctx, int index, int);
+
+	std::deque<Task> tasks;		//deque 保证 add 时已有任务的地址不变
+	JobSystem* running = nullptr;
+	std::atomic<int>* remaining = nullptr;
+};
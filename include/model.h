@@ -1,8 +1,18 @@
 #pragma once
 #include <string>
 #include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
 #include "vector.h"
 
+//һ߼ڵ棬face[1] == -1 ʾ߽ (ֻһ)
+struct MeshEdge {
+	int v[2];			//v[0] < v[1]
+	int face[2];		//ڵ
+	float cos_dihedral;	//淨߼нǵң߽Ϊ 1湲ķα߼Ϊ -1ܱۺ
+};
+
 class Model
 {
 public:
@@ -12,10 +22,27 @@ public:
 	Vec3f vert(const int i) const;		//صi
 	Vec3f vert(const int iface, const int nthvert) const;		//صifacenthvert
 	int vert_idx(const int iface, const int jvert) const;
+	Vec3f bbox_min() const;		//ģͿռΧеС
+	Vec3f bbox_max() const;		//ģͿռΧе
+	const std::vector<MeshEdge>& edges() const;		//ȥغı߼ڽ棬һεʱ棬̰߳ȫ
+	Vec3f face_normal(const int iface) const;		//ģͿռ䵥λ淨ߣʱ뷽
+	std::size_t geometry_bytes() const;		//ռõڴ (㣬ÿ浥Ķѷ)
+	std::size_t edge_bytes() const;		//߱ռõڴ棬ûʱΪ 0
+	std::size_t memory_bytes() const;		//geometry_bytes() + edge_bytes()
 	
 private:
 	std::vector<Vec3f> verts;
 	std::vector<std::vector<int>> faces;
+	Vec3f bmin, bmax;
+	//ֻ߱/߿õ轨ڶ Model Կƶ
+	struct EdgeCache {
+		std::once_flag once;
+		std::atomic<bool> built{ false };
+		std::vector<MeshEdge> list;
+	};
+	std::unique_ptr<EdgeCache> edge_cache = std::make_unique<EdgeCache>();
+
+	void build_edges(std::vector<MeshEdge>& out) const;
 	
 };
 
@@ -0,0 +1,47 @@
+#pragma once
+#include <span>
+#include <vector>
+#include "vector.h"
+#include "model.h"
+#include "tgaimage.h"
+
+// ==========================================
+// 轮廓/特征边提取
+// 只画屏幕上有意义的边，而不是每条内部边:
+//   轮廓边 (silhouette): 相邻两个面一个朝前一个朝后，随视角变化，每帧重新判断
+//   折痕边 (crease):     相邻两个面法线夹角超过阈值，与视角无关
+//   边界边 (boundary):   只属于一个面
+// 边和邻接面来自 Model::edges()，第一次描边/线框时建表并缓存，这里只做逐面朝向判断和逐边分类
+// ==========================================
+
+enum OutlineEdgeKind : unsigned {
+	OUTLINE_SILHOUETTE = 1u << 0,
+	OUTLINE_CREASE = 1u << 1,
+	OUTLINE_BOUNDARY = 1u << 2,
+	OUTLINE_FEATURES = OUTLINE_SILHOUETTE | OUTLINE_CREASE | OUTLINE_BOUNDARY,
+};
+
+struct OutlineOptions {
+	unsigned kinds = OUTLINE_FEATURES;		//要提取的边类型，OutlineEdgeKind 按位或
+	float crease_angle = 60.0f;				//法线夹角超过这么多度算折痕
+};
+
+struct OutlineStats {
+	int edges_total = 0;		//模型去重后的边数，也就是画全部边时要画的线数
+	int silhouette = 0;
+	int crease = 0;
+	int boundary = 0;
+	int drawn = 0;				//实际画的边数，一条边同时满足多种类型只算一次
+};
+
+//满足条件的边的下标 (Model::edges() 中的位置)，按原顺序
+//transform 把模型空间变换到 NDC，与 View::transform 相同；投影后顶点逆时针的面朝前
+//edge_ids 和中间数组都分配在当前线程的 frame arena 上，调用者的 ArenaScope 结束或帧结束后失效
+OutlineStats extract_outline(const Model& model, const Mat4f& transform, const OutlineOptions& options, std::span<const int>& edge_ids);
+
+//提取并用 draw_lines 并行画出特征边
+OutlineStats draw_outline(const Model& model, const Mat4f& transform, TGAImage& framebuffer, TGAColor color,
+	const OutlineOptions& options = OutlineOptions());
+
+//线框: 不做分类，画 Model::edges() 的全部边，每条共享边只画一次，返回画的边数
+int draw_wireframe(const Model& model, const Mat4f& transform, TGAImage& framebuffer, TGAColor color);
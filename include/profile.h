@@ -0,0 +1,76 @@
+#pragma once
+#include <string>
+
+// ==========================================
+// 管线埋点: 作用域计时 + 每线程计数器，可以导出 Chrome trace_event JSON (chrome://tracing 或 Perfetto 打开)
+// 只有定义了 TINYRENDERER_PROFILE (CMake 选项 profile) 才生效，
+// 否则 PROFILE_SCOPE / PROFILE_COUNT 展开为空，下面的函数都是空的内联函数，不留下任何开销
+//
+//   PROFILE_SCOPE("name");            从这里到作用域结束记一个时间段，name 必须是字符串字面量
+//   PROFILE_COUNT(PROFILE_X, n);      当前线程的计数器加 n
+//   profile_end_frame(w * h);         一帧结束时调用 (没有任务运行时)，汇总各线程计数并记一帧
+//   profile_write_trace("a.json");    导出全部时间段和每帧的计数
+// ==========================================
+
+#ifdef TINYRENDERER_PROFILE
+constexpr bool PROFILE_ENABLED = true;
+#else
+constexpr bool PROFILE_ENABLED = false;
+#endif
+
+enum ProfileCounter {
+	PROFILE_TRIANGLES_IN,		//进入光栅化的三角形
+	PROFILE_TRIANGLES_OUT,		//没有被剔除、真正光栅化的三角形
+	PROFILE_PIXELS_TESTED,		//做了覆盖测试的像素
+	PROFILE_PIXELS_WRITTEN,		//写入了颜色或深度的像素
+	PROFILE_LINES,				//画的线段
+	PROFILE_LINE_PIXELS,		//线段写入的像素
+	PROFILE_COUNTER_COUNT
+};
+
+struct ProfileCounters {
+	long long value[PROFILE_COUNTER_COUNT] = {};
+	long long operator[](ProfileCounter c) const { return value[c]; }
+};
+
+#ifdef TINYRENDERER_PROFILE
+
+void profile_add(ProfileCounter counter, long long n);
+
+class ProfileScope {
+public:
+	explicit ProfileScope(const char* name);
+	~ProfileScope();
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+	const char* name;
+	long long start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(counter, n) profile_add(counter, n)
+
+//所有线程累计的计数
+ProfileCounters profile_counters();
+//frame_pixels 是这一帧的屏幕像素数，用来算平均 overdraw (写入像素数 / 屏幕像素数)
+void profile_end_frame(long long frame_pixels);
+//写出 Chrome trace_event JSON，失败返回 false
+bool profile_write_trace(const std::string& path);
+//清空所有时间段、帧记录和计数
+void profile_reset();
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(counter, n) ((void)0)
+
+inline ProfileCounters profile_counters() { return {}; }
+inline void profile_end_frame(long long) {}
+inline bool profile_write_trace(const std::string&) { return false; }
+inline void profile_reset() {}
+
+#endif
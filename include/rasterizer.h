@@ -0,0 +1,130 @@
+#pragma once
+#include <algorithm>
+#include <span>
+#include <vector>
+#include "tgaimage.h"
+#include "model.h"
+#include "job_system.h"
+#include "frame_arena.h"
+#include "profile.h"
+
+class CompactModel;
+
+constexpr int RASTER_TILE_SIZE = 64;	//分箱光栅化的屏幕tile边长 (像素)
+constexpr int MICRO_TRIANGLE_SIZE = 3;	//包围盒宽高都不超过这么多像素的三角形走微三角形快速路径
+
+//三角形走了哪条光栅化路径的统计
+//按光栅化调用计数，分箱后跨多个tile的三角形每个tile各算一次
+struct RasterStats {
+	long long culled = 0;		//裁剪区外、背面或退化，setup之前就丢弃 (包括分箱时丢弃的)
+	long long micro = 0;		//微三角形快速路径
+	long long full = 0;			//普通路径
+};
+
+//每个线程单独一个计数槽并按缓存行对齐，计数时不会互相争抢
+struct alignas(64) RasterCounterSlot {
+	RasterStats stats;
+};
+//线程第一次计数时领一个空闲槽 (池外线程也各自一个)，线程退出时归还给之后新建的线程，槽里的计数保留
+RasterCounterSlot* claim_raster_slot();
+inline thread_local RasterCounterSlot* t_raster_slot = nullptr;
+//当前线程的计数
+inline RasterStats& local_raster_stats() {
+	if (!t_raster_slot) t_raster_slot = claim_raster_slot();
+	return t_raster_slot->stats;
+}
+
+//所有线程的计数之和
+RasterStats raster_stats();
+void reset_raster_stats();
+
+//worh: width or height
+int project(float pos, int worh);
+
+double signed_triangle_area(int ax, int ay, int bx, int by, int cx, int cy);
+
+//两倍有向面积，整数精确计算，与 signed_triangle_area 的值和符号完全一致
+inline long long signed_area2(long long ax, long long ay, long long bx, long long by, long long cx, long long cy) {
+	return (by - ay) * (bx + ax) + (cy - by) * (cx + bx) + (ay - cy) * (ax + cx);
+}
+
+//Bresenham 画线，先裁剪到 framebuffer 再按行/列连续写入，像素与逐点 set 完全相同
+void draw_line(int x0, int y0, int x1, int y1, TGAImage& framebuffer, TGAColor color);
+
+//只画落在 [clip_x0,clip_x1]x[clip_y0,clip_y1] 内的像素，与 draw_line 的像素相同
+void draw_line_clipped(int x0, int y0, int x1, int y1, int clip_x0, int clip_y0, int clip_x1, int clip_y1, TGAImage& framebuffer, TGAColor color);
+
+//endpoints[2i], endpoints[2i+1] 是第i条线段的两端；按tile分箱后并行绘制，结果与逐条调用 draw_line 相同
+void draw_lines(std::span<const Vec2i> endpoints, TGAImage& framebuffer, TGAColor color);
+
+void triangle(int ax, int ay, int bx, int by, int cx, int cy, TGAImage& framebuffer, TGAColor color);
+
+//只画落在 [clip_x0,clip_x1]x[clip_y0,clip_y1] 内的像素，与 triangle() 覆盖判定相同
+void triangle_clipped(int ax, int ay, int bx, int by, int cx, int cy, int clip_x0, int clip_y0, int clip_x1, int clip_y1, TGAImage& framebuffer, TGAColor color);
+
+//由面索引哈希出的颜色，确定性且线程安全，用来代替逐面调用 std::rand()
+TGAColor face_color(int iface);
+
+//三角形会被画出的像素所在的tile范围 [tx0,tx1]x[ty0,ty1]；背面/退化或完全在屏幕外时返回 false 并计入 culled
+bool triangle_tiles(const Vec2i& a, const Vec2i& b, const Vec2i& c, int width, int height, int& tx0, int& ty0, int& tx1, int& ty1);
+
+//按tile分箱的结果，tile(t) 是落在第t个tile里的条目，按条目序号递增
+struct TileBins {
+	std::span<int> tile_start;		//num_tiles+1 个
+	std::span<int> items;
+	std::span<const int> tile(int t) const {
+		return std::span<const int>(items.data() + tile_start[t], tile_start[t + 1] - tile_start[t]);
+	}
+};
+
+//计数排序式的分箱，所有数组都从 arena 分配，没有逐个tile的动态数组
+//visit(i, emit) 对第i个条目覆盖的每个tile调用一次 emit(tile)，会被调用两遍 (计数、填入)，两遍必须一致
+template<class Visit>
+TileBins bin_to_tiles(FrameArena& arena, int num_items, int num_tiles, int grain, const Visit& visit) {
+	PROFILE_SCOPE("bin");
+	JobSystem& jobs = JobSystem::instance();
+	const int num_chunks = std::max(1, (num_items + grain - 1) / grain);
+	//cursor[c * num_tiles + t]: 先是第c块落在tile t里的条目数，前缀和之后是它在 items 里的写入位置
+	std::span<int> cursor = arena.alloc_filled<int>(static_cast<std::size_t>(num_chunks) * num_tiles, 0);
+
+	jobs.parallel_for(0, num_chunks, 1, [&](int lo, int hi) {
+		for (int c = lo; c < hi; c++) {
+			int* counts = cursor.data() + static_cast<std::size_t>(c) * num_tiles;
+			int last = std::min(num_items, (c + 1) * grain);
+			for (int i = c * grain; i < last; i++) visit(i, [&](int t) { counts[t]++; });
+		}
+	});
+
+	//同一tile内按块序排列，块内按条目序，所以整体仍按条目序号递增
+	TileBins bins;
+	bins.tile_start = arena.alloc<int>(num_tiles + 1);
+	int total = 0;
+	for (int t = 0; t < num_tiles; t++) {
+		bins.tile_start[t] = total;
+		for (int c = 0; c < num_chunks; c++) {
+			int& n = cursor[static_cast<std::size_t>(c) * num_tiles + t];
+			int count = n;
+			n = total;
+			total += count;
+		}
+	}
+	bins.tile_start[num_tiles] = total;
+	bins.items = arena.alloc<int>(total);
+
+	jobs.parallel_for(0, num_chunks, 1, [&](int lo, int hi) {
+		for (int c = lo; c < hi; c++) {
+			int* next = cursor.data() + static_cast<std::size_t>(c) * num_tiles;
+			int last = std::min(num_items, (c + 1) * grain);
+			for (int i = c * grain; i < last; i++) visit(i, [&](int t) { bins.items[next[t]++] = i; });
+		}
+	});
+	return bins;
+}
+
+//把模型所有顶点投影到屏幕坐标
+void project_vertices(const Model& model, int width, int height, std::vector<Vec2i>& screen_coords);
+
+//填充整个模型，colors[i] 是第i个面的颜色；按tile分箱后并行光栅化，结果与按面序逐个调用 triangle() 相同
+void draw_model(const Model& model, TGAImage& framebuffer, const std::vector<TGAColor>& colors);
+//同上，顶点着色之前先按块批量反量化到 frame arena
+void draw_model(const CompactModel& model, TGAImage& framebuffer, const std::vector<TGAColor>& colors);
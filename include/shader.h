@@ -0,0 +1,294 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <vector>
+#include "vector.h"
+#include "model.h"
+#include "tgaimage.h"
+#include "rasterizer.h"
+#include "job_system.h"
+#include "profile.h"
+
+// ==========================================
+// 编译期特化的着色管线
+// 着色器是一个普通的结构体，作为模板参数传给 rasterize / draw_mesh，
+// 所有调用都在编译期确定并内联，每种着色器组合都会生成自己独立的内层循环
+//
+// 着色器需要提供:
+//   static constexpr int  varyings;      每顶点输出的浮点数个数，按重心坐标插值，0 表示不插值
+//   static constexpr bool depth_test;    深度测试 (并在片元通过后写深度)
+//   static constexpr bool color_write;   是否写颜色
+//   static constexpr bool blend;         是否与目标颜色混合，需要 TGAColor blend_colors(src, dst) const
+//   static constexpr bool discard;       fragment 是否可能返回 false (比如 alpha test)，为 false 时 fragment 必须总是返回 true
+//   Vec3f vertex(int iface, int nthvert, Varying& out) const;        返回NDC坐标
+//   bool fragment(int iface, const Varying& in, TGAColor& color) const; 返回 false 丢弃该片元
+// 关闭的功能用 if constexpr 整段去掉，不产生任何运行时开销
+// ==========================================
+
+template<int N>
+using Varyings = std::array<float, N>;
+
+struct RenderTarget {
+	TGAImage* color = nullptr;
+	float* depth = nullptr;		//width*height，值越大越靠近相机，没有深度测试时可以为空
+	//draw_mesh 只画这个矩形 (含边界) 里的像素，只对与它相交的tile分箱和光栅化，默认是整个 framebuffer
+	int scissor_x0 = 0, scissor_y0 = 0;
+	int scissor_x1 = std::numeric_limits<int>::max(), scissor_y1 = std::numeric_limits<int>::max();
+};
+
+//单个三角形，坐标与 triangle() 一样是整数像素，覆盖判定也完全相同
+//按(裁剪后)包围盒大小选择路径:
+//  完全在裁剪区外或背面/退化 -> 在任何setup之前丢弃
+//  包围盒不超过 MICRO_TRIANGLE_SIZE -> 直接逐个测试不超过 3x3 个采样点
+//  其余 -> 边函数按行增量步进
+//被剔除时返回 false
+template<class Shader>
+bool rasterize(const Shader& shader, int iface, const Vec2i p[3], const float z[3],
+	const typename Shader::Varying var[3], const RenderTarget& target,
+	int clip_x0, int clip_y0, int clip_x1, int clip_y1) {
+	RasterStats& stats = local_raster_stats();
+	const int ax = p[0].x, ay = p[0].y, bx = p[1].x, by = p[1].y, cx = p[2].x, cy = p[2].y;
+	int bboxmin_x = std::max(std::min({ ax, bx, cx }), clip_x0);
+	int bboxmax_x = std::min(std::max({ ax, bx, cx }), clip_x1);
+	int bboxmin_y = std::max(std::min({ ay, by, cy }), clip_y0);
+	int bboxmax_y = std::min(std::max({ ay, by, cy }), clip_y1);
+	long long area2 = signed_area2(ax, ay, bx, by, cx, cy);
+	//total_area < 1 即 area2 < 2
+	if (bboxmin_x > bboxmax_x || bboxmin_y > bboxmax_y || area2 < 2) {
+		stats.culled++;
+		return false;
+	}
+	PROFILE_COUNT(PROFILE_PIXELS_TESTED, static_cast<long long>(bboxmax_x - bboxmin_x + 1) * (bboxmax_y - bboxmin_y + 1));
+	long long written = 0;
+	const double total_area = .5 * area2;
+	const int width = target.color->width();
+
+	//w0/w1/w2 是三个子三角形的两倍面积，全部非负时像素被覆盖
+	auto shade_pixel = [&](int x, int y, long long w0, long long w1, long long w2) {
+		double alpha = .5 * w0 / total_area;
+		double beta = .5 * w1 / total_area;
+		double gamma = .5 * w2 / total_area;
+
+		float depth = 0.0f;
+		if constexpr (Shader::depth_test) {
+			depth = static_cast<float>(alpha * z[0] + beta * z[1] + gamma * z[2]);
+			if (depth <= target.depth[x + y * width]) return;
+		}
+
+		typename Shader::Varying in{};
+		if constexpr (Shader::varyings > 0) {
+			for (int k = 0; k < Shader::varyings; k++)
+				in[k] = static_cast<float>(alpha * var[0][k] + beta * var[1][k] + gamma * var[2][k]);
+		}
+		else {
+			(void)alpha; (void)beta; (void)gamma;
+		}
+
+		TGAColor color;
+		if (!shader.fragment(iface, in, color)) return;
+
+		if constexpr (PROFILE_ENABLED) written++;
+		if constexpr (Shader::depth_test) target.depth[x + y * width] = depth;
+		if constexpr (Shader::color_write) {
+			if constexpr (Shader::blend) color = shader.blend_colors(color, target.color->get(x, y));
+			target.color->set(x, y, color);
+		}
+	};
+
+	if (bboxmax_x - bboxmin_x < MICRO_TRIANGLE_SIZE && bboxmax_y - bboxmin_y < MICRO_TRIANGLE_SIZE) {
+		stats.micro++;
+		for (int y = bboxmin_y; y <= bboxmax_y; y++) {
+			for (int x = bboxmin_x; x <= bboxmax_x; x++) {
+				long long w0 = signed_area2(x, y, bx, by, cx, cy);
+				long long w1 = signed_area2(ax, ay, x, y, cx, cy);
+				long long w2 = signed_area2(ax, ay, bx, by, x, y);
+				if ((w0 | w1 | w2) < 0) continue;
+				shade_pixel(x, y, w0, w1, w2);
+			}
+		}
+		PROFILE_COUNT(PROFILE_PIXELS_WRITTEN, written);
+		return true;
+	}
+
+	stats.full++;
+	//边函数对 x、y 都是线性的，先在包围盒左下角求值，之后每步加常数
+	long long row0 = signed_area2(bboxmin_x, bboxmin_y, bx, by, cx, cy);
+	long long row1 = signed_area2(ax, ay, bboxmin_x, bboxmin_y, cx, cy);
+	long long row2 = signed_area2(ax, ay, bx, by, bboxmin_x, bboxmin_y);
+	const long long dx0 = by - cy, dy0 = cx - bx;
+	const long long dx1 = cy - ay, dy1 = ax - cx;
+	const long long dx2 = ay - by, dy2 = bx - ax;
+	for (int y = bboxmin_y; y <= bboxmax_y; y++) {
+		long long w0 = row0, w1 = row1, w2 = row2;
+		for (int x = bboxmin_x; x <= bboxmax_x; x++) {
+			if ((w0 | w1 | w2) >= 0) shade_pixel(x, y, w0, w1, w2);
+			w0 += dx0;
+			w1 += dx1;
+			w2 += dx2;
+		}
+		row0 += dy0;
+		row1 += dy1;
+		row2 += dy2;
+	}
+	PROFILE_COUNT(PROFILE_PIXELS_WRITTEN, written);
+	return true;
+}
+
+//完整的网格管线: 顶点着色 -> 按tile分箱 -> tile并行光栅化
+//同一tile内按面序绘制，因此没有深度测试时结果也与串行逐面绘制相同
+//Mesh 是 Model、CompactModel 或 DequantizedMesh，这里只用到面数，顶点由着色器自己读
+template<class Shader, class Mesh>
+void draw_mesh(const Mesh& model, const Shader& shader, const RenderTarget& target) {
+	PROFILE_SCOPE("draw_mesh");
+	struct ShadedTriangle {
+		Vec2i p[3];
+		float z[3];
+		typename Shader::Varying var[3];
+		bool visible;
+		int tx0, ty0, tx1, ty1;
+	};
+
+	JobSystem& jobs = JobSystem::instance();
+	const int width = target.color->width();
+	const int height = target.color->height();
+	const int num_faces = model.nfaces();
+	//裁剪矩形与屏幕的交集，以及它覆盖的tile范围，tile编号相对于 (tile_x0, tile_y0)
+	const int scissor_x0 = std::max(target.scissor_x0, 0);
+	const int scissor_y0 = std::max(target.scissor_y0, 0);
+	const int scissor_x1 = std::min(target.scissor_x1, width - 1);
+	const int scissor_y1 = std::min(target.scissor_y1, height - 1);
+	if (scissor_x0 > scissor_x1 || scissor_y0 > scissor_y1) return;
+	const int tile_x0 = scissor_x0 / RASTER_TILE_SIZE;
+	const int tile_y0 = scissor_y0 / RASTER_TILE_SIZE;
+	const int tiles_x = scissor_x1 / RASTER_TILE_SIZE - tile_x0 + 1;
+	const int tiles_y = scissor_y1 / RASTER_TILE_SIZE - tile_y0 + 1;
+	const int num_tiles = tiles_x * tiles_y;
+	constexpr int BIN_GRAIN = 2048;
+
+	//临时数组都来自当前线程的 frame arena，函数返回时一起释放
+	ArenaScope arena;
+	std::span<ShadedTriangle> tris = arena->alloc<ShadedTriangle>(num_faces);
+
+	//顶点着色，同时求出每个三角形覆盖的tile范围
+	jobs.parallel_for(0, num_faces, BIN_GRAIN, [&](int lo, int hi) {
+		PROFILE_SCOPE("vertex");
+		for (int i = lo; i < hi; i++) {
+			ShadedTriangle& tri = tris[i];
+			for (int j = 0; j < 3; j++) {
+				Vec3f ndc = shader.vertex(i, j, tri.var[j]);
+				tri.p[j] = Vec2i(project(ndc.x, width), project(ndc.y, height));
+				tri.z[j] = ndc.z;
+			}
+			tri.visible = triangle_tiles(tri.p[0], tri.p[1], tri.p[2], width, height, tri.tx0, tri.ty0, tri.tx1, tri.ty1);
+			if (!tri.visible) continue;
+			tri.tx0 = std::max(tri.tx0, tile_x0) - tile_x0;
+			tri.ty0 = std::max(tri.ty0, tile_y0) - tile_y0;
+			tri.tx1 = std::min(tri.tx1, tile_x0 + tiles_x - 1) - tile_x0;
+			tri.ty1 = std::min(tri.ty1, tile_y0 + tiles_y - 1) - tile_y0;
+			tri.visible = tri.tx0 <= tri.tx1 && tri.ty0 <= tri.ty1;
+		}
+	});
+
+	TileBins bins = bin_to_tiles(*arena, num_faces, num_tiles, BIN_GRAIN, [&](int i, auto&& emit) {
+		const ShadedTriangle& tri = tris[i];
+		if (!tri.visible) return;
+		for (int ty = tri.ty0; ty <= tri.ty1; ty++)
+			for (int tx = tri.tx0; tx <= tri.tx1; tx++)
+				emit(ty * tiles_x + tx);
+	});
+
+	jobs.parallel_for(0, num_tiles, 1, [&](int lo, int hi) {
+		PROFILE_SCOPE("raster");
+		for (int t = lo; t < hi; t++) {
+			int x0 = (tile_x0 + t % tiles_x) * RASTER_TILE_SIZE;
+			int y0 = (tile_y0 + t / tiles_x) * RASTER_TILE_SIZE;
+			int x1 = std::min(x0 + RASTER_TILE_SIZE - 1, scissor_x1);
+			int y1 = std::min(y0 + RASTER_TILE_SIZE - 1, scissor_y1);
+			x0 = std::max(x0, scissor_x0);
+			y0 = std::max(y0, scissor_y0);
+			for (int i : bins.tile(t))
+				rasterize(shader, i, tris[i].p, tris[i].z, tris[i].var, target, x0, y0, x1, y1);
+		}
+	});
+}
+
+// ==========================================
+// 内置着色器
+// 读模型的着色器以网格类型为模板参数，XxxShader 是 Model 版本，
+// 量化模型用 BasicXxxShader{ &compact_model, ... } 或 BasicXxxShader{ &dequantized_mesh, ... }，模板参数会自动推导
+// ==========================================
+
+//单色填充，triangle() 就是用它实现的
+struct FillShader {
+	static constexpr int varyings = 0;
+	static constexpr bool depth_test = false;
+	static constexpr bool color_write = true;
+	static constexpr bool blend = false;
+	static constexpr bool discard = false;
+	using Varying = Varyings<varyings>;
+
+	TGAColor color;
+
+	bool fragment(int, const Varying&, TGAColor& out) const { out = color; return true; }
+};
+
+//每个面一个颜色，不做深度测试 (画家算法)，draw_model 就是用它实现的
+template<class Mesh>
+struct BasicFlatShader {
+	static constexpr int varyings = 0;
+	static constexpr bool depth_test = false;
+	static constexpr bool color_write = true;
+	static constexpr bool blend = false;
+	static constexpr bool discard = false;
+	using Varying = Varyings<varyings>;
+
+	const Mesh* model;
+	const TGAColor* colors;		//每面颜色
+
+	Vec3f vertex(int iface, int nthvert, Varying&) const { return model->vert(iface, nthvert); }
+	bool fragment(int iface, const Varying&, TGAColor& out) const { out = colors[iface]; return true; }
+};
+using FlatShader = BasicFlatShader<Model>;
+
+//逐顶点颜色在三角形内插值，带深度测试
+template<class Mesh>
+struct BasicGouraudShader {
+	static constexpr int varyings = 3;
+	static constexpr bool depth_test = true;
+	static constexpr bool color_write = true;
+	static constexpr bool blend = false;
+	static constexpr bool discard = false;
+	using Varying = Varyings<varyings>;
+
+	const Mesh* model;
+	const TGAColor* vertex_colors;		//每顶点颜色
+
+	Vec3f vertex(int iface, int nthvert, Varying& out) const {
+		TGAColor c = vertex_colors[model->vert_idx(iface, nthvert)];
+		for (int k = 0; k < 3; k++) out[k] = c.bgra[k];
+		return model->vert(iface, nthvert);
+	}
+	bool fragment(int, const Varying& in, TGAColor& out) const {
+		for (int k = 0; k < 3; k++) out[k] = static_cast<std::uint8_t>(std::clamp(in[k], 0.0f, 255.0f));
+		return true;
+	}
+};
+using GouraudShader = BasicGouraudShader<Model>;
+
+//只写深度，用来做深度预pass
+template<class Mesh>
+struct BasicDepthOnlyShader {
+	static constexpr int varyings = 0;
+	static constexpr bool depth_test = true;
+	static constexpr bool color_write = false;
+	static constexpr bool blend = false;
+	static constexpr bool discard = false;
+	using Varying = Varyings<varyings>;
+
+	const Mesh* model;
+
+	Vec3f vertex(int iface, int nthvert, Varying&) const { return model->vert(iface, nthvert); }
+	bool fragment(int, const Varying&, TGAColor&) const { return true; }
+};
+using DepthOnlyShader = BasicDepthOnlyShader<Model>;
@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "model.h"
+#include "tgaimage.h"
+
+// ==========================================
+// 多进程 sort-first 渲染
+// 超大分辨率 (比如 16K 海报) 时单个进程受限于一个 NUMA 节点的内存带宽。
+// 协调进程把画面按行切成横带，每条横带 fork 一个工作进程:
+//   - 工作进程先绑定到一个 NUMA 节点的 CPU 上，再在节点内起自己的 JobSystem
+//   - framebuffer 是 MAP_SHARED 的匿名映射，工作进程先清零自己的横带 (first-touch，页面落在本节点的内存上)，
+//     再用 RenderTarget 的裁剪矩形只光栅化这条横带，直接写进共享内存
+//   - 模型在 fork 前已经加载，子进程以写时复制方式共享，只读访问不会复制页面
+// 横带在第一次渲染时按投影后三角形覆盖的tile数估计工作量来划分，尽量让各进程同时画完；
+// 边界对齐到既是整页又是整tile行的行数，相邻横带不共用页面。之后每帧沿用同一划分和同一节点，
+// 页面一直留在第一次清零它的节点上。画面内容变化很大需要重新平衡时，换一块新的 SharedFramebuffer
+// 结果与单进程 draw_model 逐字节相同。fork/亲和性只在 Linux 上有，其他平台在本进程内直接渲染
+// 调用时不能有 JobSystem 任务在运行
+// ==========================================
+
+struct SortFirstOptions {
+	int processes = 0;		//工作进程数，<=0 时每个 NUMA 节点一个
+	int threads = 0;		//每个工作进程的线程数，<=0 时平分所在节点的 CPU
+	bool pin = true;		//把工作进程 i 绑定到第 i % 节点数 个 NUMA 节点
+};
+
+struct SortFirstBand {
+	int y0 = 0, y1 = -1;	//负责的行 [y0, y1]
+	int node = -1;			//绑定的 NUMA 节点，不绑定时为 -1
+	int threads = 0;
+	double ms = 0;			//工作进程从 fork 到画完的时间
+};
+
+struct SortFirstStats {
+	int numa_nodes = 0;
+	std::vector<SortFirstBand> bands;
+	double split_ms = 0;	//协调进程估计工作量、划分横带的时间，沿用已有划分时为 0
+	double render_ms = 0;	//从第一次 fork 到所有工作进程退出
+};
+
+class SharedFramebuffer;
+
+//用多个工作进程填充整个模型，colors 同 draw_model；fork 失败或有工作进程异常退出时返回 false
+bool render_sort_first(const Model& model, const std::vector<TGAColor>& colors, SharedFramebuffer& framebuffer,
+	const SortFirstOptions& options = SortFirstOptions(), SortFirstStats* stats = nullptr);
+
+//像素放在进程间共享的匿名映射里，fork 出的子进程写入后父进程直接可见
+class SharedFramebuffer {
+public:
+	SharedFramebuffer(int width, int height, int bpp);
+	~SharedFramebuffer();
+	SharedFramebuffer(const SharedFramebuffer&) = delete;
+	SharedFramebuffer& operator=(const SharedFramebuffer&) = delete;
+
+	//映射失败时为 false，image() 是空图像
+	bool valid() const { return pixels != nullptr; }
+	//包装共享内存的图像，可以直接传给各种绘制函数和 write_tga_file
+	TGAImage& image() { return view; }
+	const TGAImage& image() const { return view; }
+	std::uint8_t* data() { return pixels; }
+	std::size_t row_bytes() const { return stride; }
+	//render_sort_first 第一次划定后固定的横带 (只用到 y0/y1)，还没渲染过时为空
+	const std::vector<SortFirstBand>& bands() const { return layout; }
+
+private:
+	friend bool render_sort_first(const Model& model, const std::vector<TGAColor>& colors, SharedFramebuffer& framebuffer,
+		const SortFirstOptions& options, SortFirstStats* stats);
+
+	std::uint8_t* pixels = nullptr;
+	std::size_t stride = 0;
+	std::size_t bytes = 0;
+	TGAImage view;
+	std::vector<SortFirstBand> layout;
+	int layout_requested = 0;		//划分 layout 时请求的横带数
+};
+
+//每个 NUMA 节点上当前进程允许使用的 CPU，没有节点信息时当作一个节点
+std::vector<std::vector<int>> numa_node_cpus();
@@ -30,19 +30,31 @@ struct TGAImage {
     enum Format { GRAYSCALE=1, RGB=3, RGBA=4 };
     TGAImage() = default;
     TGAImage(const int w, const int h, const int bpp);
+    // wraps w*h*bpp caller-owned bytes (e.g. a shared memory mapping) without copying them;
+    // the memory must outlive the image, and copies of the image refer to the same pixels
+    TGAImage(const int w, const int h, const int bpp, std::uint8_t *pixels);
+    TGAImage(const TGAImage &other);
+    TGAImage(TGAImage &&other) noexcept;
+    TGAImage &operator=(const TGAImage &other);
+    TGAImage &operator=(TGAImage &&other) noexcept;
     bool  read_tga_file(const std::string filename);
     bool write_tga_file(const std::string filename, const bool vflip=true, const bool rle=true) const;
     void flip_horizontally();
     void flip_vertically();
     TGAColor get(const int x, const int y) const;
     void set(const int x, const int y, const TGAColor &c);
+    void clear();
+    // no bounds check: the caller clips, x0<=x1 / y0<=y1 inside the image
+    void fill_row(const int x0, const int x1, const int y, const TGAColor &c);
+    void fill_column(const int x, const int y0, const int y1, const TGAColor &c);
     int width()  const;
     int height() const;
 private:
     bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out) const;
+    void unload_rle_data(const size_t first, const size_t last, std::vector<std::uint8_t> &out) const;
     int w = 0, h = 0;
     std::uint8_t bpp = 0;
     std::vector<std::uint8_t> data = {};
+    std::uint8_t *pixels = nullptr; // data.data(), or the caller's memory for a wrapping image
 };
 
@@ -164,4 +164,29 @@ struct Mat2f {
      *        ע⣺ѹһ
      */
     void SymEigens(float outEigenValues[2], Mat2f& outEigenVectors) const;
-};
\ No newline at end of file
+};
+
+// ==========================================
+// Mat4f: 4x4 α任
+// 洢ʽ:  (Row-Major) (x, y, z, 1)
+// ==========================================
+struct Mat4f {
+    float m[4][4];
+
+    // Ĭϵλ
+    Mat4f();
+
+    static Mat4f Translation(const Vec3f& t);
+    static Mat4f Scale(const Vec3f& s);
+    //yת ()
+    static Mat4f RotationY(float angleRad);
+    // centereye Ϊλ
+    static Mat4f LookAt(const Vec3f& eye, const Vec3f& center, const Vec3f& up);
+    //͸:  z = focal ԭ (w = 1 - z / focal)
+    static Mat4f Perspective(float focal);
+
+    Mat4f operator*(const Mat4f& other) const;
+
+    //任һ㣬͸ӳ
+    Vec3f transform_point(const Vec3f& p) const;
+};
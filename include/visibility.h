@@ -0,0 +1,139 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+#include "shader.h"
+
+// ==========================================
+// 可见性缓冲 (延迟着色)
+// 第一遍只光栅化深度 + 32位三角形ID，第二遍对每个像素只着色一次:
+// 按ID从网格重新取该面的三个顶点、算重心坐标、插值 varyings 后调用片元着色
+// 着色开销只和屏幕像素数有关，与 overdraw 无关 (会丢弃片元的着色器在第一遍还要逐片元调一次 fragment)
+// 深度测试沿用着色器自己的设置: 没有深度测试时ID按面序覆盖，与前向画家算法的结果相同
+// ==========================================
+
+struct VisibilityBuffer {
+	static constexpr std::uint32_t EMPTY = 0;		//ID 里存的是 面索引+1，0 表示没有覆盖
+
+	TGAImage ids;				//RGBA 每像素4字节，正好放一个 32 位ID
+	std::vector<float> depth;
+
+	VisibilityBuffer(int width, int height);
+	void clear();
+	int width() const { return ids.width(); }
+	int height() const { return ids.height(); }
+	//返回覆盖 (x,y) 的面索引，没有则返回 -1
+	int face(int x, int y) const;
+};
+
+//第一遍用的着色器: 几何和深度测试与内层着色器完全相同，片元只把面ID写进颜色
+//内层着色器可能丢弃片元时，先插值它的 varyings 调一次它的 fragment，被丢弃的片元不写ID
+//混合的结果取决于所有层，只着色最前面一层得不到，所以不接受 blend 的着色器
+template<class Shader>
+struct VisibilityShader {
+	static_assert(!Shader::blend, "visibility buffer shades only the front-most fragment, blending needs every layer");
+	static constexpr int varyings = Shader::discard ? Shader::varyings : 0;
+	static constexpr bool depth_test = Shader::depth_test;
+	static constexpr bool color_write = true;
+	static constexpr bool blend = false;
+	static constexpr bool discard = Shader::discard;
+	using Varying = std::conditional_t<Shader::discard, typename Shader::Varying, Varyings<0>>;
+
+	const Shader* inner;
+
+	Vec3f vertex(int iface, int nthvert, Varying& out) const {
+		if constexpr (Shader::discard) {
+			return inner->vertex(iface, nthvert, out);
+		}
+		else {
+			typename Shader::Varying unused;
+			return inner->vertex(iface, nthvert, unused);
+		}
+	}
+	bool fragment(int iface, const Varying& in, TGAColor& out) const {
+		if constexpr (Shader::discard) {
+			if (!inner->fragment(iface, in, out)) return false;
+		}
+		std::uint32_t id = static_cast<std::uint32_t>(iface) + 1;
+		for (int k = 0; k < 4; k++) out.bgra[k] = static_cast<std::uint8_t>(id >> (8 * k));
+		return true;
+	}
+};
+
+//包装一个着色器，统计片元着色的调用次数，用来比较前向和延迟两种方式的着色量
+template<class Shader>
+struct CountingShader {
+	static constexpr int varyings = Shader::varyings;
+	static constexpr bool depth_test = Shader::depth_test;
+	static constexpr bool color_write = Shader::color_write;
+	static constexpr bool blend = Shader::blend;
+	static constexpr bool discard = Shader::discard;
+	using Varying = typename Shader::Varying;
+
+	const Shader* inner;
+	std::atomic<long long>* invocations;
+
+	Vec3f vertex(int iface, int nthvert, Varying& out) const { return inner->vertex(iface, nthvert, out); }
+	bool fragment(int iface, const Varying& in, TGAColor& out) const {
+		invocations->fetch_add(1, std::memory_order_relaxed);
+		return inner->fragment(iface, in, out);
+	}
+	TGAColor blend_colors(const TGAColor& src, const TGAColor& dst) const { return inner->blend_colors(src, dst); }
+};
+
+//第一遍: 深度 + ID，Mesh 与 draw_mesh 相同 (Model、CompactModel 或 DequantizedMesh)
+template<class Shader, class Mesh>
+void render_visibility(const Mesh& model, const Shader& shader, VisibilityBuffer& vb) {
+	vb.clear();
+	RenderTarget target;
+	target.color = &vb.ids;
+	target.depth = vb.depth.data();
+	draw_mesh(model, VisibilityShader<Shader>{ &shader }, target);
+}
+
+//第二遍: 每个被覆盖的像素调用一次片元着色，返回着色的像素数
+template<class Shader>
+long long resolve_visibility(const Shader& shader, const VisibilityBuffer& vb, TGAImage& framebuffer) {
+	const int width = vb.width();
+	const int height = vb.height();
+	std::atomic<long long> shaded(0);
+
+	JobSystem::instance().parallel_for(0, height, 8, [&](int lo, int hi) {
+		long long local = 0;
+		for (int y = lo; y < hi; y++) {
+			for (int x = 0; x < width; x++) {
+				int iface = vb.face(x, y);
+				if (iface < 0) continue;
+
+				//重新取顶点，坐标和第一遍光栅化时完全一样
+				typename Shader::Varying var[3];
+				Vec2i p[3];
+				for (int j = 0; j < 3; j++) {
+					Vec3f ndc = shader.vertex(iface, j, var[j]);
+					p[j] = Vec2i(project(ndc.x, width), project(ndc.y, height));
+				}
+				double total_area = signed_triangle_area(p[0].x, p[0].y, p[1].x, p[1].y, p[2].x, p[2].y);
+				double alpha = signed_triangle_area(x, y, p[1].x, p[1].y, p[2].x, p[2].y) / total_area;
+				double beta = signed_triangle_area(p[0].x, p[0].y, x, y, p[2].x, p[2].y) / total_area;
+				double gamma = signed_triangle_area(p[0].x, p[0].y, p[1].x, p[1].y, x, y) / total_area;
+
+				typename Shader::Varying in{};
+				if constexpr (Shader::varyings > 0) {
+					for (int k = 0; k < Shader::varyings; k++)
+						in[k] = static_cast<float>(alpha * var[0][k] + beta * var[1][k] + gamma * var[2][k]);
+				}
+
+				TGAColor color;
+				local++;
+				if (!shader.fragment(iface, in, color)) continue;
+				if constexpr (Shader::color_write) {
+					if constexpr (Shader::blend) color = shader.blend_colors(color, framebuffer.get(x, y));
+					framebuffer.set(x, y, color);
+				}
+			}
+		}
+		shaded.fetch_add(local, std::memory_order_relaxed);
+	});
+	return shaded.load();
+}
@@ -0,0 +1,49 @@
+#include "../include/batch.h"
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+#include "../include/frame_arena.h"
+#include "../include/profile.h"
+
+BatchRenderer::BatchRenderer(const Model& model) : model(model) {
+	int num_faces = model.nfaces();
+	colors.resize(num_faces);
+	for (int i = 0; i < num_faces; i++) colors[i] = face_color(i);
+}
+
+void BatchRenderer::render(const std::vector<View>& views, std::vector<TGAImage>& framebuffers) {
+	JobSystem& jobs = JobSystem::instance();
+	int num_views = static_cast<int>(views.size());
+	if (static_cast<int>(framebuffers.size()) < num_views) framebuffers.resize(num_views);
+
+	jobs.parallel_for(0, num_views, 1, [&](int lo, int hi) {
+		for (int v = lo; v < hi; v++) {
+			const View& view = views[v];
+			TGAImage& framebuffer = framebuffers[v];
+			if (framebuffer.width() != view.width || framebuffer.height() != view.height)
+				framebuffer = TGAImage(view.width, view.height, TGAImage::RGB);
+			else
+				framebuffer.clear();
+			render_view(view, framebuffer);
+		}
+	});
+}
+
+void BatchRenderer::render_view(const View& view, TGAImage& framebuffer) const {
+	PROFILE_SCOPE("render_view");
+	//单个 view 内部串行，线程间并行在帧这一层；投影结果放在执行线程自己的 frame arena 上
+	int num_verts = model.nverts();
+	int num_faces = model.nfaces();
+	ArenaScope arena;
+	std::span<Vec2i> screen_coords = arena->alloc<Vec2i>(num_verts);
+	for (int i = 0; i < num_verts; i++) {
+		Vec3f v = view.transform.transform_point(model.vert(i));
+		screen_coords[i] = Vec2i(project(v.x, view.width), project(v.y, view.height));
+	}
+
+	for (int i = 0; i < num_faces; i++) {
+		const Vec2i& a = screen_coords[model.vert_idx(i, 0)];
+		const Vec2i& b = screen_coords[model.vert_idx(i, 1)];
+		const Vec2i& c = screen_coords[model.vert_idx(i, 2)];
+		triangle(a.x, a.y, b.x, b.y, c.x, c.y, framebuffer, colors[i]);
+	}
+}
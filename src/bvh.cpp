@@ -0,0 +1,345 @@
+#include <algorithm>
+#include <limits>
+#include "../include/bvh.h"
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+
+namespace {
+
+constexpr int SAH_BINS = 16;			//分箱数量
+constexpr int LEAF_SIZE = 4;			//图元数不超过这个值直接做叶子
+constexpr int PARALLEL_THRESHOLD = 4096;	//子树图元数超过这个值才拆成两个并行任务
+constexpr int MAX_SAH_DEPTH = 48;		//超过这个深度改用中位数切分，剩余深度最多 log2(n)
+constexpr int STACK_SIZE = 96;
+
+//两个凸多边形的分离轴测试，边界接触也算相交
+bool convex_overlap(const Vec2f* a, int na, const Vec2f* b, int nb) {
+	const Vec2f* polys[2] = { a, b };
+	const int sizes[2] = { na, nb };
+	for (int p = 0; p < 2; p++) {
+		for (int i = 0; i < sizes[p]; i++) {
+			Vec2f axis = (polys[p][(i + 1) % sizes[p]] - polys[p][i]).perp();
+			if (axis.length_sq() == 0.0f) continue;
+
+			float mina = std::numeric_limits<float>::max(), maxa = std::numeric_limits<float>::lowest();
+			float minb = mina, maxb = maxa;
+			for (int k = 0; k < na; k++) {
+				float d = axis.dot(a[k]);
+				mina = std::min(mina, d);
+				maxa = std::max(maxa, d);
+			}
+			for (int k = 0; k < nb; k++) {
+				float d = axis.dot(b[k]);
+				minb = std::min(minb, d);
+				maxb = std::max(maxb, d);
+			}
+			if (maxa < minb || maxb < mina) return false;
+		}
+	}
+	return true;
+}
+
+}
+
+// ==========================================
+// AABB2D
+// ==========================================
+
+AABB2D::AABB2D()
+	: min(std::numeric_limits<float>::max(), std::numeric_limits<float>::max()),
+	  max(std::numeric_limits<float>::lowest(), std::numeric_limits<float>::lowest()) {}
+
+AABB2D::AABB2D(const Vec2f& min_, const Vec2f& max_) : min(min_), max(max_) {}
+
+void AABB2D::expand(const Vec2f& p) {
+	min.x = std::min(min.x, p.x);
+	min.y = std::min(min.y, p.y);
+	max.x = std::max(max.x, p.x);
+	max.y = std::max(max.y, p.y);
+}
+
+void AABB2D::expand(const AABB2D& other) {
+	min.x = std::min(min.x, other.min.x);
+	min.y = std::min(min.y, other.min.y);
+	max.x = std::max(max.x, other.max.x);
+	max.y = std::max(max.y, other.max.y);
+}
+
+bool AABB2D::empty() const {
+	return min.x > max.x || min.y > max.y;
+}
+
+float AABB2D::half_perimeter() const {
+	if (empty()) return 0.0f;
+	return (max.x - min.x) + (max.y - min.y);
+}
+
+Vec2f AABB2D::center() const {
+	return (min + max) * 0.5f;
+}
+
+bool AABB2D::containsPoint(const Vec2f& p) const {
+	return p.x >= min.x && p.x <= max.x && p.y >= min.y && p.y <= max.y;
+}
+
+bool AABB2D::overlaps(const AABB2D& other) const {
+	return min.x <= other.max.x && max.x >= other.min.x &&
+		min.y <= other.max.y && max.y >= other.min.y;
+}
+
+OBB2D AABB2D::toOBB() const {
+	return OBB2D(center(), max.x - min.x, max.y - min.y, 0.0f);
+}
+
+// ==========================================
+// ScreenBVH 构建
+// ==========================================
+
+void ScreenBVH::project_verts(const Model& model, int width, int height) {
+	project_vertices(model, width, height, screen_verts);
+}
+
+AABB2D ScreenBVH::face_box(int iface) const {
+	AABB2D box;
+	for (int j = 0; j < 3; j++) box.expand(Vec2f(screen_verts[face_verts[iface * 3 + j]]));
+	return box;
+}
+
+void ScreenBVH::triangle_corners(int iface, Vec2f out[3]) const {
+	for (int j = 0; j < 3; j++) out[j] = screen_verts[face_verts[iface * 3 + j]];
+}
+
+void ScreenBVH::build(const Model& model, int width, int height) {
+	int num_faces = model.nfaces();
+	project_verts(model, width, height);
+
+	face_verts.resize(num_faces * 3);
+	prim_boxes.resize(num_faces);
+	prims.resize(num_faces);
+	JobSystem::instance().parallel_for(0, num_faces, 4096, [&](int lo, int hi) {
+		for (int i = lo; i < hi; i++) {
+			for (int j = 0; j < 3; j++) face_verts[i * 3 + j] = model.vert_idx(i, j);
+			prim_boxes[i] = face_box(i);
+			prims[i] = i;
+		}
+	});
+
+	nodes.clear();
+	node_count = 0;
+	if (num_faces == 0) return;
+
+	//n 个图元的二叉树最多 2n-1 个节点，预先分配好，并行建树时只需原子地递增 node_count
+	nodes.resize(2 * num_faces - 1);
+	node_count = 1;
+	build_node(0, 0, num_faces, 0);
+	nodes.resize(node_count.load());
+
+	prim_boxes.clear();
+	prim_boxes.shrink_to_fit();
+}
+
+void ScreenBVH::build_node(int inode, int first, int count, int depth) {
+	Node& node = nodes[inode];
+	AABB2D box, centroid_box;
+	for (int i = first; i < first + count; i++) {
+		box.expand(prim_boxes[prims[i]]);
+		centroid_box.expand(prim_boxes[prims[i]].center());
+	}
+	node.box = box;
+	node.first = first;
+	node.count = count;
+	if (count <= LEAF_SIZE) return;
+
+	//沿质心分布最长的轴分箱
+	int axis = (centroid_box.max.x - centroid_box.min.x) >= (centroid_box.max.y - centroid_box.min.y) ? 0 : 1;
+	float cmin = axis == 0 ? centroid_box.min.x : centroid_box.min.y;
+	float cmax = axis == 0 ? centroid_box.max.x : centroid_box.max.y;
+
+	int mid = first + count / 2;
+	if (cmax > cmin && depth < MAX_SAH_DEPTH) {
+		float scale = SAH_BINS / (cmax - cmin);
+		auto bin_of = [&](int prim) {
+			Vec2f c = prim_boxes[prim].center();
+			int b = static_cast<int>(((axis == 0 ? c.x : c.y) - cmin) * scale);
+			return std::min(b, SAH_BINS - 1);
+		};
+
+		AABB2D bin_box[SAH_BINS];
+		int bin_count[SAH_BINS] = {};
+		for (int i = first; i < first + count; i++) {
+			int b = bin_of(prims[i]);
+			bin_box[b].expand(prim_boxes[prims[i]]);
+			bin_count[b]++;
+		}
+
+		//从右往左扫一遍累计右侧代价，再从左往右找最优分割
+		float right_cost[SAH_BINS] = {};
+		AABB2D acc;
+		int acc_count = 0;
+		for (int b = SAH_BINS - 1; b > 0; b--) {
+			acc.expand(bin_box[b]);
+			acc_count += bin_count[b];
+			right_cost[b] = acc.half_perimeter() * acc_count;
+		}
+
+		float best_cost = std::numeric_limits<float>::max();
+		int best_split = -1;
+		acc = AABB2D();
+		acc_count = 0;
+		for (int b = 0; b < SAH_BINS - 1; b++) {
+			acc.expand(bin_box[b]);
+			acc_count += bin_count[b];
+			float cost = acc.half_perimeter() * acc_count + right_cost[b + 1];
+			if (acc_count > 0 && acc_count < count && cost < best_cost) {
+				best_cost = cost;
+				best_split = b;
+			}
+		}
+
+		//分割不比直接做叶子划算就停下
+		float leaf_cost = box.half_perimeter() * count;
+		if (best_split >= 0 && best_cost >= leaf_cost && count <= 2 * LEAF_SIZE) return;
+
+		if (best_split >= 0) {
+			mid = static_cast<int>(std::partition(prims.begin() + first, prims.begin() + first + count,
+				[&](int prim) { return bin_of(prim) <= best_split; }) - prims.begin());
+		}
+	}
+	//质心全部重合时没法分箱，退化成按中位数切分，保证树深度为 O(log n)
+	if (mid == first || mid == first + count) mid = first + count / 2;
+
+	int left = node_count.fetch_add(2);
+	node.first = left;
+	node.count = 0;
+
+	if (count > PARALLEL_THRESHOLD) {
+		JobSystem::instance().parallel_for(0, 2, 1, [&](int lo, int hi) {
+			for (int k = lo; k < hi; k++) {
+				if (k == 0) build_node(left, first, mid - first, depth + 1);
+				else build_node(left + 1, mid, first + count - mid, depth + 1);
+			}
+		});
+	}
+	else {
+		build_node(left, first, mid - first, depth + 1);
+		build_node(left + 1, mid, first + count - mid, depth + 1);
+	}
+}
+
+// ==========================================
+// ScreenBVH 更新
+// ==========================================
+
+void ScreenBVH::refit_leaf(Node& node) const {
+	AABB2D box;
+	for (int i = node.first; i < node.first + node.count; i++) box.expand(face_box(prims[i]));
+	node.box = box;
+}
+
+void ScreenBVH::refit(const Model& model, int width, int height) {
+	project_verts(model, width, height);
+	int num_nodes = nnodes();
+
+	JobSystem::instance().parallel_for(0, num_nodes, 1024, [&](int lo, int hi) {
+		for (int i = lo; i < hi; i++) {
+			if (nodes[i].leaf()) refit_leaf(nodes[i]);
+		}
+	});
+
+	//孩子的下标总是大于父节点，倒序遍历就是自底向上
+	for (int i = num_nodes - 1; i >= 0; i--) {
+		Node& node = nodes[i];
+		if (node.leaf()) continue;
+		node.box = nodes[node.first].box;
+		node.box.expand(nodes[node.first + 1].box);
+	}
+}
+
+// ==========================================
+// ScreenBVH 查询
+// ==========================================
+
+int ScreenBVH::pick(int x, int y) const {
+	if (nodes.empty()) return -1;
+	Vec2f p(static_cast<float>(x), static_cast<float>(y));
+	int best = -1;
+	int stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!node.box.containsPoint(p)) continue;
+		if (!node.leaf()) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			int iface = prims[i];
+			if (iface <= best) continue;
+			const Vec2i& a = screen_verts[face_verts[iface * 3]];
+			const Vec2i& b = screen_verts[face_verts[iface * 3 + 1]];
+			const Vec2i& c = screen_verts[face_verts[iface * 3 + 2]];
+			//与 triangle() 完全相同的覆盖判定
+			double total_area = signed_triangle_area(a.x, a.y, b.x, b.y, c.x, c.y);
+			if (total_area < 1) continue;
+			if (signed_triangle_area(x, y, b.x, b.y, c.x, c.y) < 0) continue;
+			if (signed_triangle_area(a.x, a.y, x, y, c.x, c.y) < 0) continue;
+			if (signed_triangle_area(a.x, a.y, b.x, b.y, x, y) < 0) continue;
+			best = iface;
+		}
+	}
+	return best;
+}
+
+void ScreenBVH::query_rect(int x0, int y0, int x1, int y1, std::vector<int>& out) const {
+	out.clear();
+	if (nodes.empty()) return;
+	AABB2D rect(Vec2f(static_cast<float>(std::min(x0, x1)), static_cast<float>(std::min(y0, y1))),
+		Vec2f(static_cast<float>(std::max(x0, x1)), static_cast<float>(std::max(y0, y1))));
+	Vec2f rect_corners[4] = { rect.min, Vec2f(rect.max.x, rect.min.y), rect.max, Vec2f(rect.min.x, rect.max.y) };
+
+	int stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!node.box.overlaps(rect)) continue;
+		if (!node.leaf()) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			Vec2f tri[3];
+			triangle_corners(prims[i], tri);
+			if (convex_overlap(tri, 3, rect_corners, 4)) out.push_back(prims[i]);
+		}
+	}
+	std::sort(out.begin(), out.end());
+}
+
+void ScreenBVH::query_obb(const OBB2D& box, std::vector<int>& out) const {
+	out.clear();
+	if (nodes.empty()) return;
+	std::vector<Vec2f> corners = box.getCorners();
+
+	int stack[STACK_SIZE];
+	int top = 0;
+	stack[top++] = 0;
+	while (top > 0) {
+		const Node& node = nodes[stack[--top]];
+		if (!node.box.toOBB().Intersects(box)) continue;
+		if (!node.leaf()) {
+			stack[top++] = node.first;
+			stack[top++] = node.first + 1;
+			continue;
+		}
+		for (int i = node.first; i < node.first + node.count; i++) {
+			Vec2f tri[3];
+			triangle_corners(prims[i], tri);
+			if (convex_overlap(tri, 3, corners.data(), 4)) out.push_back(prims[i]);
+		}
+	}
+	std::sort(out.begin(), out.end());
+}
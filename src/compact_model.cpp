@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/compact_model.h"
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+
+namespace {
+
+constexpr float QUANT_MAX = 65535.0f;
+constexpr float SNORM_MAX = 32767.0f;
+
+float sign_not_zero(float v) {
+	return v >= 0.0f ? 1.0f : -1.0f;
+}
+
+//八面体映射: 单位球投到 |x|+|y|+|z|=1 的八面体上，下半部分折到正方形的四个角
+void encode_octahedral(const Vec3f& n, std::int16_t& u, std::int16_t& v) {
+	float l1 = std::abs(n.x) + std::abs(n.y) + std::abs(n.z);
+	float x = 0.0f, y = 0.0f;
+	if (l1 > 0.0f) {
+		x = n.x / l1;
+		y = n.y / l1;
+		if (n.z < 0.0f) {
+			float fx = (1.0f - std::abs(y)) * sign_not_zero(x);
+			float fy = (1.0f - std::abs(x)) * sign_not_zero(y);
+			x = fx;
+			y = fy;
+		}
+	}
+	u = static_cast<std::int16_t>(std::lround(std::clamp(x, -1.0f, 1.0f) * SNORM_MAX));
+	v = static_cast<std::int16_t>(std::lround(std::clamp(y, -1.0f, 1.0f) * SNORM_MAX));
+}
+
+Vec3f decode_octahedral(std::int16_t u, std::int16_t v) {
+	float x = u / SNORM_MAX;
+	float y = v / SNORM_MAX;
+	float z = 1.0f - std::abs(x) - std::abs(y);
+	if (z < 0.0f) {
+		float fx = (1.0f - std::abs(y)) * sign_not_zero(x);
+		float fy = (1.0f - std::abs(x)) * sign_not_zero(y);
+		x = fx;
+		y = fy;
+	}
+	return Vec3f(x, y, z).normalize();
+}
+
+std::uint16_t quantize(float v, float lo, float extent) {
+	if (extent <= 0.0f) return 0;
+	return static_cast<std::uint16_t>(std::lround(std::clamp((v - lo) / extent, 0.0f, 1.0f) * QUANT_MAX));
+}
+
+//未经修正的顶点法线: 相邻面法线之和
+std::vector<Vec3f> vertex_normals(const Model& model) {
+	std::vector<Vec3f> normals(model.nverts(), Vec3f(0, 0, 0));
+	for (int i = 0; i < model.nfaces(); i++) {
+		Vec3f n = model.face_normal(i);
+		for (int j = 0; j < 3; j++) {
+			Vec3f& acc = normals[model.vert_idx(i, j)];
+			acc = acc + n;
+		}
+	}
+	return normals;
+}
+
+}
+
+CompactModel::CompactModel(const Model& model) {
+	JobSystem& jobs = JobSystem::instance();
+	int num_verts = model.nverts();
+	num_faces = model.nfaces();
+	bmin = model.bbox_min();
+	bmax = model.bbox_max();
+	Vec3f extent = bmax - bmin;
+	offset = bmin;
+	scale = Vec3f(extent.x / QUANT_MAX, extent.y / QUANT_MAX, extent.z / QUANT_MAX);
+
+	//1. 位置
+	qx.resize(num_verts);
+	qy.resize(num_verts);
+	qz.resize(num_verts);
+	normals.resize(2 * static_cast<std::size_t>(num_verts));
+	std::vector<Vec3f> vnormals = vertex_normals(model);
+	jobs.parallel_for(0, num_verts, 4096, [&](int lo, int hi) {
+		for (int i = lo; i < hi; i++) {
+			Vec3f v = model.vert(i);
+			qx[i] = quantize(v.x, bmin.x, extent.x);
+			qy[i] = quantize(v.y, bmin.y, extent.y);
+			qz[i] = quantize(v.z, bmin.z, extent.z);
+			encode_octahedral(vnormals[i].normalize(), normals[2 * i], normals[2 * i + 1]);
+		}
+	});
+
+	//2. 索引，按 meshlet 存相对基准的偏移; 先定下每个 meshlet 用哪种宽度，两个数组都只分配实际用到的部分
+	int num_meshlets = (num_faces + MESHLET_FACES - 1) / MESHLET_FACES;
+	meshlets.resize(num_meshlets);
+	std::size_t local_count = 0, wide_count = 0;
+	for (int m = 0; m < num_meshlets; m++) {
+		int first = m * MESHLET_FACES;
+		int last = std::min(num_faces, first + MESHLET_FACES);
+		int lo = model.vert_idx(first, 0), hi = lo;
+		for (int i = first; i < last; i++)
+			for (int j = 0; j < 3; j++) {
+				lo = std::min(lo, model.vert_idx(i, j));
+				hi = std::max(hi, model.vert_idx(i, j));
+			}
+
+		Meshlet& meshlet = meshlets[m];
+		meshlet.base = lo;
+		meshlet.wide = hi - lo > 0xFFFF;
+		std::size_t& count = meshlet.wide ? wide_count : local_count;
+		meshlet.start = static_cast<int>(count);
+		count += 3 * static_cast<std::size_t>(last - first);
+	}
+	local_indices.resize(local_count);
+	wide_indices.resize(wide_count);
+	jobs.parallel_for(0, num_meshlets, 16, [&](int lo, int hi) {
+		for (int m = lo; m < hi; m++) {
+			const Meshlet& meshlet = meshlets[m];
+			int first = m * MESHLET_FACES;
+			int last = std::min(num_faces, first + MESHLET_FACES);
+			for (int i = first; i < last; i++)
+				for (int j = 0; j < 3; j++) {
+					std::size_t k = meshlet.start + 3 * static_cast<std::size_t>(i - first) + j;
+					if (meshlet.wide) wide_indices[k] = model.vert_idx(i, j);
+					else local_indices[k] = static_cast<std::uint16_t>(model.vert_idx(i, j) - meshlet.base);
+				}
+		}
+	});
+}
+
+Vec3f CompactModel::normal(const int i) const {
+	return decode_octahedral(normals[2 * i], normals[2 * i + 1]);
+}
+
+void CompactModel::dequantize(int first, int last, Vec3f* out) const {
+	//三个轴分开各走一遍，每遍都是 uint16 -> float 的乘加，可以向量化
+	const std::uint16_t* x = qx.data();
+	const std::uint16_t* y = qy.data();
+	const std::uint16_t* z = qz.data();
+	for (int i = first; i < last; i++) out[i - first].x = offset.x + x[i] * scale.x;
+	for (int i = first; i < last; i++) out[i - first].y = offset.y + y[i] * scale.y;
+	for (int i = first; i < last; i++) out[i - first].z = offset.z + z[i] * scale.z;
+}
+
+DequantizedMesh::DequantizedMesh(const CompactModel& model, FrameArena& arena)
+	: source(&model), positions(arena.alloc<Vec3f>(model.nverts())) {
+	JobSystem::instance().parallel_for(0, model.nverts(), 4096, [&](int lo, int hi) {
+		model.dequantize(lo, hi, positions.data() + lo);
+	});
+}
+
+std::size_t CompactModel::memory_bytes() const {
+	return sizeof(*this)
+		+ (qx.capacity() + qy.capacity() + qz.capacity()) * sizeof(std::uint16_t)
+		+ normals.capacity() * sizeof(std::int16_t)
+		+ meshlets.capacity() * sizeof(Meshlet)
+		+ local_indices.capacity() * sizeof(std::uint16_t)
+		+ wide_indices.capacity() * sizeof(int);
+}
+
+QuantizationReport CompactModel::measure_error(const Model& source, const Mat4f& transform, int width, int height) const {
+	QuantizationReport report;
+	report.source_bytes = source.geometry_bytes();
+	report.source_edge_bytes = source.edge_bytes();
+	report.compact_bytes = memory_bytes();
+
+	int num_verts = nverts();
+	std::vector<Vec3f> decoded(num_verts);
+	dequantize(0, num_verts, decoded.data());
+	std::vector<Vec3f> vnormals = vertex_normals(source);
+
+	for (int i = 0; i < num_verts; i++) {
+		Vec3f a = source.vert(i);
+		Vec3f b = decoded[i];
+		report.max_position_error = std::max({ report.max_position_error, std::abs(a.x - b.x), std::abs(a.y - b.y), std::abs(a.z - b.z) });
+
+		//与 project() 相同的映射，但不取整
+		Vec3f pa = transform.transform_point(a);
+		Vec3f pb = transform.transform_point(b);
+		float dx = (pa.x - pb.x) * width / 2.0f;
+		float dy = (pa.y - pb.y) * height / 2.0f;
+		report.max_error_pixels = std::max(report.max_error_pixels, std::sqrt(dx * dx + dy * dy));
+		if (project(pa.x, width) != project(pb.x, width) || project(pa.y, height) != project(pb.y, height)) report.moved_vertices++;
+
+		Vec3f n = vnormals[i].normalize();
+		if (n.dot(n) > 0.0f) {
+			float c = std::clamp(n.dot(normal(i)), -1.0f, 1.0f);
+			report.max_normal_error_deg = std::max(report.max_normal_error_deg, std::acos(c) * 180.0f / 3.14159265f);
+		}
+	}
+	return report;
+}
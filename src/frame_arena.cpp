@@ -0,0 +1,109 @@
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include "../include/frame_arena.h"
+
+namespace {
+
+constexpr std::size_t MIN_BLOCK_SIZE = 1 << 16;
+
+//所有线程的 arena，end_frame 时逐个归零
+//工作线程在 JobSystem 析构时才退出并注销自己的 arena，可能晚于本文件的静态对象析构，所以 Registry 故意不释放
+struct Registry {
+	std::mutex mutex;
+	std::vector<FrameArena*> arenas;
+	ArenaStats stats;
+};
+
+Registry& registry() {
+	static Registry* r = new Registry;
+	return *r;
+}
+
+std::atomic<long long> block_allocations{ 0 };
+
+}
+
+FrameArena::FrameArena() {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.arenas.push_back(this);
+}
+
+FrameArena::~FrameArena() {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	r.arenas.erase(std::find(r.arenas.begin(), r.arenas.end(), this));
+}
+
+FrameArena& FrameArena::local() {
+	thread_local FrameArena arena;
+	return arena;
+}
+
+void* FrameArena::allocate(std::size_t bytes, std::size_t align) {
+	while (true) {
+		if (current < blocks.size()) {
+			Block& block = blocks[current];
+			std::size_t start = (offset + align - 1) / align * align;
+			if (start + bytes <= block.size) {
+				offset = start + bytes;
+				peak = std::max(peak, block.base + offset);
+				return block.data.get() + start;
+			}
+			//当前块放不下，先试后面已有的块 (之前回退留下的)
+			if (current + 1 < blocks.size()) {
+				current++;
+				offset = 0;
+				continue;
+			}
+		}
+		add_block(bytes + align);
+		current = blocks.size() - 1;
+		offset = 0;
+	}
+}
+
+void FrameArena::add_block(std::size_t min_size) {
+	std::size_t size = std::max(min_size, MIN_BLOCK_SIZE);
+	if (!blocks.empty()) size = std::max(size, blocks.back().size * 2);
+	Block block;
+	//operator new[] 返回的内存按 max_align_t 对齐
+	block.data.reset(new std::byte[size]);
+	block.size = size;
+	block.base = blocks.empty() ? 0 : blocks.back().base + blocks.back().size;
+	blocks.push_back(std::move(block));
+	block_allocations.fetch_add(1, std::memory_order_relaxed);
+}
+
+void FrameArena::reset() {
+	//这一帧用了不止一块，合并成一整块，下一帧同样的用量就不用再申请
+	if (blocks.size() > 1) {
+		std::size_t total = blocks.back().base + blocks.back().size;
+		blocks.clear();
+		add_block(total);
+	}
+	current = 0;
+	offset = 0;
+	peak = 0;
+}
+
+void FrameArena::end_frame() {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	std::size_t frame_peak = 0;
+	for (FrameArena* arena : r.arenas) {
+		frame_peak += arena->peak;
+		arena->reset();
+	}
+	r.stats.frame_peak = frame_peak;
+	r.stats.max_frame_peak = std::max(r.stats.max_frame_peak, frame_peak);
+}
+
+ArenaStats FrameArena::stats() {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	ArenaStats out = r.stats;
+	out.block_allocations = block_allocations.load(std::memory_order_relaxed);
+	return out;
+}
@@ -0,0 +1,148 @@
+#include <algorithm>
+#include "../include/incremental.h"
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+#include "../include/frame_arena.h"
+
+namespace {
+
+struct TileRect {
+	int tx0, ty0, tx1, ty1;		//被剔除的面是空范围 {0, 0, -1, -1}
+};
+
+}
+
+IncrementalRenderer::IncrementalRenderer(int width, int height)
+	: width(width), height(height),
+	  tiles_x((width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE),
+	  tiles_y((height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE),
+	  framebuffer(width, height, TGAImage::RGB) {
+	last_stats.tiles_total = tiles_x * tiles_y;
+}
+
+int IncrementalRenderer::add(const Model& model, const Mat4f& transform) {
+	Object object;
+	object.model = &model;
+	object.transform = transform;
+	object.tile_start.assign(tiles_x * tiles_y + 1, 0);
+	objects.push_back(std::move(object));
+
+	for (int i = static_cast<int>(colors.size()); i < model.nfaces(); i++) colors.push_back(face_color(i));
+	return static_cast<int>(objects.size()) - 1;
+}
+
+void IncrementalRenderer::set_transform(int id, const Mat4f& transform) {
+	objects[id].transform = transform;
+	objects[id].dirty = true;
+}
+
+void IncrementalRenderer::mark_dirty(int id) {
+	objects[id].dirty = true;
+}
+
+void IncrementalRenderer::rebin(Object& object, std::span<char> dirty_tiles) const {
+	const Model& model = *object.model;
+	int num_tiles = tiles_x * tiles_y;
+	int num_faces = model.nfaces();
+
+	//旧的覆盖范围
+	for (int t = 0; t < num_tiles; t++)
+		if (object.tile_start[t + 1] > object.tile_start[t]) dirty_tiles[t] = 1;
+
+	int num_verts = model.nverts();
+	object.screen_coords.resize(num_verts);
+	for (int i = 0; i < num_verts; i++) {
+		Vec3f v = object.transform.transform_point(model.vert(i));
+		object.screen_coords[i] = Vec2i(project(v.x, width), project(v.y, height));
+	}
+
+	//新的覆盖范围: 先数出每个tile的面数，前缀和之后按面序填入，数组容量跨帧复用
+	ArenaScope arena;
+	std::span<TileRect> rects = arena->alloc<TileRect>(num_faces);
+	std::fill(object.tile_start.begin(), object.tile_start.end(), 0);
+	for (int i = 0; i < num_faces; i++) {
+		const Vec2i& a = object.screen_coords[model.vert_idx(i, 0)];
+		const Vec2i& b = object.screen_coords[model.vert_idx(i, 1)];
+		const Vec2i& c = object.screen_coords[model.vert_idx(i, 2)];
+		TileRect& rect = rects[i];
+		if (!triangle_tiles(a, b, c, width, height, rect.tx0, rect.ty0, rect.tx1, rect.ty1)) {
+			rect = { 0, 0, -1, -1 };
+			continue;
+		}
+		for (int ty = rect.ty0; ty <= rect.ty1; ty++)
+			for (int tx = rect.tx0; tx <= rect.tx1; tx++) {
+				object.tile_start[ty * tiles_x + tx + 1]++;
+				dirty_tiles[ty * tiles_x + tx] = 1;
+			}
+	}
+	for (int t = 0; t < num_tiles; t++) object.tile_start[t + 1] += object.tile_start[t];
+	object.faces.resize(object.tile_start[num_tiles]);
+
+	std::span<int> next = arena->alloc<int>(num_tiles);
+	std::copy(object.tile_start.begin(), object.tile_start.end() - 1, next.begin());
+	for (int i = 0; i < num_faces; i++) {
+		const TileRect& rect = rects[i];
+		for (int ty = rect.ty0; ty <= rect.ty1; ty++)
+			for (int tx = rect.tx0; tx <= rect.tx1; tx++) object.faces[next[ty * tiles_x + tx]++] = i;
+	}
+	object.dirty = false;
+}
+
+void IncrementalRenderer::redraw_tile(int tile) {
+	int x0 = (tile % tiles_x) * RASTER_TILE_SIZE;
+	int y0 = (tile / tiles_x) * RASTER_TILE_SIZE;
+	int x1 = std::min(x0 + RASTER_TILE_SIZE, width) - 1;
+	int y1 = std::min(y0 + RASTER_TILE_SIZE, height) - 1;
+
+	const TGAColor background = {};
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			framebuffer.set(x, y, background);
+
+	for (const Object& object : objects) {
+		const Model& model = *object.model;
+		for (int k = object.tile_start[tile]; k < object.tile_start[tile + 1]; k++) {
+			int i = object.faces[k];
+			const Vec2i& a = object.screen_coords[model.vert_idx(i, 0)];
+			const Vec2i& b = object.screen_coords[model.vert_idx(i, 1)];
+			const Vec2i& c = object.screen_coords[model.vert_idx(i, 2)];
+			triangle_clipped(a.x, a.y, b.x, b.y, c.x, c.y, x0, y0, x1, y1, framebuffer, colors[i]);
+		}
+	}
+}
+
+const TGAImage& IncrementalRenderer::render() {
+	JobSystem& jobs = JobSystem::instance();
+	int num_tiles = tiles_x * tiles_y;
+
+	//每个改变的对象各用一张脏tile表，避免并行时写冲突，之后再合并
+	ArenaScope arena;
+	std::span<int> changed = arena->alloc<int>(objects.size());
+	int num_changed = 0;
+	for (int id = 0; id < static_cast<int>(objects.size()); id++)
+		if (objects[id].dirty) changed[num_changed++] = id;
+	std::span<char> object_dirty = arena->alloc_filled<char>(static_cast<std::size_t>(num_changed) * num_tiles, 0);
+	jobs.parallel_for(0, num_changed, 1, [&](int lo, int hi) {
+		for (int k = lo; k < hi; k++) rebin(objects[changed[k]], object_dirty.subspan(static_cast<std::size_t>(k) * num_tiles, num_tiles));
+	});
+
+	std::span<int> dirty_tiles = arena->alloc<int>(num_tiles);
+	int num_dirty = 0;
+	for (int t = 0; t < num_tiles; t++) {
+		for (int k = 0; k < num_changed; k++) {
+			if (object_dirty[static_cast<std::size_t>(k) * num_tiles + t]) {
+				dirty_tiles[num_dirty++] = t;
+				break;
+			}
+		}
+	}
+
+	jobs.parallel_for(0, num_dirty, 1, [&](int lo, int hi) {
+		for (int k = lo; k < hi; k++) redraw_tile(dirty_tiles[k]);
+	});
+
+	last_stats.tiles_total = num_tiles;
+	last_stats.tiles_redrawn = num_dirty;
+	last_stats.reused_fraction = num_tiles > 0 ? 1.0f - static_cast<float>(num_dirty) / num_tiles : 1.0f;
+	return framebuffer;
+}
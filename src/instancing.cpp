@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cstdint>
+#include <limits>
+#include "../include/instancing.h"
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+#include "../include/frame_arena.h"
+
+namespace {
+
+struct FaceIndices {
+	int v[3];
+};
+
+//一个 (面, 实例) 三角形覆盖的tile范围，tx0 > tx1 表示被剔除
+struct TileRect {
+	std::int16_t tx0, ty0, tx1, ty1;
+};
+
+//模型包围盒经过变换后在 xy 方向上是否与 [-1,1] 相交
+bool box_visible(const Mat4f& transform, const Vec3f& lo, const Vec3f& hi) {
+	float min_x = std::numeric_limits<float>::max(), max_x = std::numeric_limits<float>::lowest();
+	float min_y = min_x, max_y = max_x;
+	for (int k = 0; k < 8; k++) {
+		Vec3f corner((k & 1) ? hi.x : lo.x, (k & 2) ? hi.y : lo.y, (k & 4) ? hi.z : lo.z);
+		Vec3f p = transform.transform_point(corner);
+		min_x = std::min(min_x, p.x);
+		max_x = std::max(max_x, p.x);
+		min_y = std::min(min_y, p.y);
+		max_y = std::max(max_y, p.y);
+	}
+	return max_x >= -1.0f && min_x <= 1.0f && max_y >= -1.0f && min_y <= 1.0f;
+}
+
+}
+
+InstanceStats draw_instanced(const Model& model, std::span<const Mat4f> transforms, TGAImage& framebuffer,
+	const std::vector<TGAColor>& colors) {
+	JobSystem& jobs = JobSystem::instance();
+	InstanceStats stats;
+	int num_instances = static_cast<int>(transforms.size());
+	stats.submitted = num_instances;
+
+	//1. 以实例为单位整体剔除
+	ArenaScope arena;
+	std::span<char> visible = arena->alloc<char>(num_instances);
+	Vec3f lo = model.bbox_min(), hi = model.bbox_max();
+	jobs.parallel_for(0, num_instances, 256, [&](int first, int last) {
+		for (int i = first; i < last; i++) visible[i] = box_visible(transforms[i], lo, hi);
+	});
+	std::span<int> survivors = arena->alloc<int>(num_instances);
+	int num_survivors = 0;
+	for (int i = 0; i < num_instances; i++)
+		if (visible[i]) survivors[num_survivors++] = i;
+	stats.culled = num_instances - num_survivors;
+	if (num_survivors == 0) return stats;
+
+	int width = framebuffer.width();
+	int height = framebuffer.height();
+	int num_verts = model.nverts();
+	int num_faces = model.nfaces();
+	int tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	int tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	int num_tiles = tiles_x * tiles_y;
+	constexpr int BIN_GRAIN = 512;
+
+	//模型的索引只读一次，复制成连续数组，之后每批每个实例都从这里取
+	std::span<FaceIndices> faces = arena->alloc<FaceIndices>(num_faces);
+	jobs.parallel_for(0, num_faces, 4096, [&](int first, int last) {
+		for (int i = first; i < last; i++)
+			faces[i] = { { model.vert_idx(i, 0), model.vert_idx(i, 1), model.vert_idx(i, 2) } };
+	});
+	std::span<Vec2i> screen_coords = arena->alloc<Vec2i>(static_cast<size_t>(INSTANCE_BATCH) * num_verts);
+
+	for (int batch_first = 0; batch_first < num_survivors; batch_first += INSTANCE_BATCH) {
+		int batch_size = std::min(INSTANCE_BATCH, num_survivors - batch_first);
+		stats.batches++;
+		ArenaScope batch_arena;
+
+		//2. 批内所有实例的顶点一起变换，screen_coords[实例 * nverts + 顶点]
+		jobs.parallel_for(0, batch_size * num_verts, 4096, [&](int first, int last) {
+			for (int k = first; k < last; k++) {
+				const Mat4f& transform = transforms[survivors[batch_first + k / num_verts]];
+				Vec3f v = transform.transform_point(model.vert(k % num_verts));
+				screen_coords[k] = Vec2i(project(v.x, width), project(v.y, height));
+			}
+		});
+
+		//3. 三角形编号 = 实例 * num_faces + 面，先求出每个三角形的tile范围，再按编号分箱
+		//   同一tile内按实例顺序、实例内按面序，与逐个实例绘制的顺序相同
+		int num_tris = num_faces * batch_size;
+		std::span<TileRect> rects = batch_arena->alloc<TileRect>(num_tris);
+		jobs.parallel_for(0, num_faces, BIN_GRAIN, [&](int first, int last) {
+			for (int i = first; i < last; i++) {
+				const FaceIndices& f = faces[i];
+				for (int inst = 0; inst < batch_size; inst++) {
+					const Vec2i* base = screen_coords.data() + static_cast<size_t>(inst) * num_verts;
+					int tx0, ty0, tx1, ty1;
+					TileRect& rect = rects[static_cast<size_t>(inst) * num_faces + i];
+					if (triangle_tiles(base[f.v[0]], base[f.v[1]], base[f.v[2]], width, height, tx0, ty0, tx1, ty1))
+						rect = { static_cast<std::int16_t>(tx0), static_cast<std::int16_t>(ty0), static_cast<std::int16_t>(tx1), static_cast<std::int16_t>(ty1) };
+					else
+						rect = { 0, 0, -1, -1 };
+				}
+			}
+		});
+		TileBins bins = bin_to_tiles(*batch_arena, num_tris, num_tiles, BIN_GRAIN * batch_size, [&](int k, auto&& emit) {
+			const TileRect& rect = rects[k];
+			for (int ty = rect.ty0; ty <= rect.ty1; ty++)
+				for (int tx = rect.tx0; tx <= rect.tx1; tx++) emit(ty * tiles_x + tx);
+		});
+
+		//4. 按tile并行光栅化
+		jobs.parallel_for(0, num_tiles, 1, [&](int first, int last) {
+			for (int t = first; t < last; t++) {
+				int x0 = (t % tiles_x) * RASTER_TILE_SIZE;
+				int y0 = (t / tiles_x) * RASTER_TILE_SIZE;
+				int x1 = std::min(x0 + RASTER_TILE_SIZE, width) - 1;
+				int y1 = std::min(y0 + RASTER_TILE_SIZE, height) - 1;
+				for (int k : bins.tile(t)) {
+					int face = k % num_faces;
+					const FaceIndices& f = faces[face];
+					const Vec2i* base = screen_coords.data() + static_cast<size_t>(k / num_faces) * num_verts;
+					const Vec2i& a = base[f.v[0]];
+					const Vec2i& b = base[f.v[1]];
+					const Vec2i& d = base[f.v[2]];
+					triangle_clipped(a.x, a.y, b.x, b.y, d.x, d.y, x0, y0, x1, y1, framebuffer, colors[face]);
+				}
+			}
+		});
+	}
+	return stats;
+}
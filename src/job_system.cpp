@@ -0,0 +1,241 @@
+#include "../include/job_system.h"
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace {
+
+thread_local int t_thread_index = 0;
+
+std::mutex g_instance_mutex;
+std::unique_ptr<JobSystem> g_instance;
+std::atomic<JobSystem*> g_instance_ptr{ nullptr };
+
+//把线程限制在 cpus 上 (仅Linux)
+void set_affinity(std::thread::native_handle_type thread, const std::vector<int>& cpus) {
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	for (int cpu : cpus) CPU_SET(cpu % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+	(void)thread;
+	(void)cpus;
+#endif
+}
+
+}
+
+std::vector<int> allowed_cpus() {
+	std::vector<int> cpus;
+#ifdef __linux__
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	if (sched_getaffinity(0, sizeof(set), &set) == 0) {
+		for (int cpu = 0; cpu < CPU_SETSIZE; cpu++)
+			if (CPU_ISSET(cpu, &set)) cpus.push_back(cpu);
+	}
+#endif
+	if (cpus.empty()) {
+		int n = std::max(1u, std::thread::hardware_concurrency());
+		for (int cpu = 0; cpu < n; cpu++) cpus.push_back(cpu);
+	}
+	return cpus;
+}
+
+// ==========================================
+// JobSystem
+// ==========================================
+
+JobSystem::JobSystem(int num_threads, bool pin_threads) {
+	//在绑定调用线程之前读取，工作线程按进程实际允许的CPU分配，而不是 0..hardware_concurrency-1
+	std::vector<int> cpus = allowed_cpus();
+	const int num_cpus = static_cast<int>(cpus.size());
+	if (num_threads <= 0) num_threads = num_cpus;
+
+	for (int i = 0; i < num_threads; i++) queues.push_back(std::make_unique<Queue>());
+	for (int i = 1; i < num_threads; i++) {
+		workers.emplace_back(&JobSystem::worker_loop, this, i);
+		if (pin_threads) set_affinity(workers.back().native_handle(), { cpus[i % num_cpus] });
+	}
+#ifdef __linux__
+	if (pin_threads) {
+		caller_cpus = cpus;
+		pinned_caller = std::this_thread::get_id();
+		set_affinity(pthread_self(), { cpus[0] });
+	}
+#endif
+}
+
+JobSystem::~JobSystem() {
+	{
+		std::lock_guard<std::mutex> lock(sleep_mutex);
+		stopping = true;
+	}
+	sleep_cv.notify_all();
+	for (auto& t : workers) t.join();
+	restore_caller_affinity();
+}
+
+void JobSystem::restore_caller_affinity() {
+	//只能改当前线程自己的亲和性: 创建实例的线程可能已经退出
+#ifdef __linux__
+	if (!caller_cpus.empty() && pinned_caller == std::this_thread::get_id()) set_affinity(pthread_self(), caller_cpus);
+#endif
+	caller_cpus.clear();
+}
+
+int JobSystem::thread_index() {
+	return t_thread_index;
+}
+
+JobSystem& JobSystem::instance() {
+	JobSystem* jobs = g_instance_ptr.load(std::memory_order_acquire);
+	if (jobs) return *jobs;
+	std::lock_guard<std::mutex> lock(g_instance_mutex);
+	if (!g_instance) {
+		g_instance = std::make_unique<JobSystem>();
+		g_instance_ptr.store(g_instance.get(), std::memory_order_release);
+	}
+	return *g_instance;
+}
+
+void JobSystem::configure(int num_threads, bool pin_threads) {
+	std::lock_guard<std::mutex> lock(g_instance_mutex);
+	g_instance_ptr.store(nullptr, std::memory_order_release);
+	g_instance.reset();
+	g_instance = std::make_unique<JobSystem>(num_threads, pin_threads);
+	g_instance_ptr.store(g_instance.get(), std::memory_order_release);
+}
+
+void JobSystem::reinit_after_fork(int num_threads, bool pin_threads) {
+	//不加锁: 此时子进程是单线程的，而 g_instance_mutex 可能在 fork 的瞬间被父进程的其他线程持有
+	//旧实例不析构，但 fork 的线程若是被它绑定的调用线程，先恢复亲和性，新线程才会继承完整的CPU集合
+	if (g_instance) g_instance->restore_caller_affinity();
+	(void)g_instance.release();
+	g_instance = std::make_unique<JobSystem>(num_threads, pin_threads);
+	g_instance_ptr.store(g_instance.get(), std::memory_order_release);
+	t_thread_index = 0;
+}
+
+void JobSystem::submit(const Job& job) {
+	int index = thread_index();
+	if (index >= nthreads()) index = 0;
+	{
+		std::lock_guard<std::mutex> lock(queues[index]->mutex);
+		queues[index]->push_back(job);
+	}
+	queued.fetch_add(1);
+	//没有线程在睡眠时不用碰 sleep_mutex
+	if (sleeping.load() > 0) {
+		{ std::lock_guard<std::mutex> lock(sleep_mutex); }
+		sleep_cv.notify_one();
+	}
+}
+
+bool JobSystem::try_pop(int index, Job& job) {
+	//自己的队列从尾部取 (后进先出，缓存更热)
+	Queue& q = *queues[index];
+	std::lock_guard<std::mutex> lock(q.mutex);
+	if (q.empty()) return false;
+	job = q.pop_back();
+	queued.fetch_sub(1);
+	return true;
+}
+
+bool JobSystem::try_steal(int thief, Job& job) {
+	//别人的队列从头部偷 (最早提交的块通常最大)
+	int n = nthreads();
+	for (int k = 1; k < n; k++) {
+		Queue& q = *queues[(thief + k) % n];
+		std::unique_lock<std::mutex> lock(q.mutex, std::try_to_lock);
+		if (!lock.owns_lock() || q.empty()) continue;
+		job = q.pop_front();
+		queued.fetch_sub(1);
+		return true;
+	}
+	return false;
+}
+
+void JobSystem::run(const Job& job) {
+	job.fn(job.ctx, job.lo, job.hi);
+	if (job.counter) job.counter->fetch_sub(1, std::memory_order_acq_rel);
+}
+
+void JobSystem::wait(const std::atomic<int>& counter) {
+	int index = thread_index();
+	if (index >= nthreads()) index = 0;
+	Job job;
+	while (counter.load(std::memory_order_acquire) > 0) {
+		if (try_pop(index, job) || try_steal(index, job)) run(job);
+		else std::this_thread::yield();
+	}
+}
+
+void JobSystem::worker_loop(int index) {
+	t_thread_index = index;
+	Job job;
+	while (true) {
+		if (try_pop(index, job) || try_steal(index, job)) {
+			run(job);
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(sleep_mutex);
+		sleeping.fetch_add(1);
+		sleep_cv.wait(lock, [&] { return queued.load() > 0 || stopping; });
+		sleeping.fetch_sub(1);
+		if (stopping && queued.load() == 0) return;
+	}
+}
+
+// ==========================================
+// TaskGraph
+// ==========================================
+
+int TaskGraph::add(std::function<void()> fn) {
+	tasks.emplace_back();
+	tasks.back().fn = std::move(fn);
+	return ntasks() - 1;
+}
+
+void TaskGraph::precede(int a, int b) {
+	tasks[a].successors.push_back(b);
+	tasks[b].num_predecessors++;
+}
+
+void TaskGraph::execute(const void* ctx, int index, int) {
+	TaskGraph* graph = const_cast<TaskGraph*>(static_cast<const TaskGraph*>(ctx));
+	Task& task = graph->tasks[index];
+	task.fn();
+	for (int s : task.successors) {
+		if (graph->tasks[s].pending.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+			JobSystem::Job job;
+			job.fn = &TaskGraph::execute;
+			job.ctx = graph;
+			job.lo = s;
+			job.counter = graph->remaining;
+			graph->running->submit(job);
+		}
+	}
+}
+
+void TaskGraph::run(JobSystem& jobs) {
+	if (tasks.empty()) return;
+	std::atomic<int> counter(ntasks());
+	running = &jobs;
+	remaining = &counter;
+	for (auto& task : tasks) task.pending.store(task.num_predecessors, std::memory_order_relaxed);
+	for (int i = 0; i < ntasks(); i++) {
+		if (tasks[i].num_predecessors > 0) continue;
+		JobSystem::Job job;
+		job.fn = &TaskGraph::execute;
+		job.ctx = this;
+		job.lo = i;
+		job.counter = &counter;
+		jobs.submit(job);
+	}
+	jobs.wait(counter);
+	running = nullptr;
+	remaining = nullptr;
+}
@@ -1,14 +1,36 @@
 #include <string>
 #include <iostream>
 #include <vector>
-#include <fstream>
 #include <chrono>
-#include <sstream>
+#include <cstdlib>
 #include <cmath>
 #include <algorithm>
+#include <memory>
 #include "../include/model.h"
 #include "../include/tgaimage.h"
-#include "../include/obb2d.h"
+#include "../include/rasterizer.h"
+#include "../include/batch.h"
+#include "../include/job_system.h"
+#include "../include/outline.h"
+#include "../include/frame_arena.h"
+#include "../include/profile.h"
+#include "../include/sort_first.h"
+
+// ==========================================
+// tinyrenderer: ޽Ⱦ򣬷űܺɨ
+//
+// ÷: tinyrenderer [ģ.obj] [--width N] [--height N] [--frames N] [--threads N]
+//                    [--mode fill|wireframe|outline] [--output ļ] [--format tga|tga-raw|none]
+//                    [--processes N] [--stats] [--trace ļ]
+//
+//   fill        (BatchRendererÿ֡߳֡)
+//   wireframe  ģ͵ȫ
+//   outline    ֻߡۺ۱ߺͱ߽
+//   --processes  fill ģʽ fork N ̰ sort-first Ⱦڴ ( sort_first.h)
+//                ʱ --threads ÿ̵߳
+//   --stats    ׼ֻӡһ JSON  (/Ⱦ/дļʱÿ֡ʱͳ)Ϣӡ
+//   --trace    profile µ Chrome trace_event JSON
+// ==========================================
 
 constexpr TGAColor white   = {255, 255, 255, 255}; // attention, BGRA order
 constexpr TGAColor green   = {  0, 255,   0, 255};
@@ -16,183 +38,209 @@ constexpr TGAColor red     = {  0,   0, 255, 255};
 constexpr TGAColor blue    = {255, 128,  64, 255};
 constexpr TGAColor yellow  = {  0, 200, 255, 255};
 
-struct Edge {
-	int u, v;
-	// <  sort
-	bool operator<(const Edge& other) const {
-		if (u != other.u) return u < other.u;
-		return v < other.v;
-	}
-	// == жظ
-	bool operator==(const Edge& other) const {
-		return u == other.u && v == other.v;
-	}
+namespace {
+
+struct Options {
+	std::string model_path = "obj/diablo3_pose/diablo3_pose.obj";	//ĬԹĿ¼ʾģ
+	int width = 800;
+	int height = 800;
+	int frames = 1;
+	int threads = 0;				//0 ʾ JobSystem Ĭ߳
+	int processes = 0;				//0 ʾ
+	std::string mode = "fill";
+	std::string output = "Triangle.tga";
+	std::string format = "tga";		//tga Ϊ RLE ѹtga-raw ѹnone дļ
+	bool stats = false;
+	std::string trace_path;
 };
 
-void draw_line(int x0, int y0, int x1, int y1, TGAImage& framebuffer, TGAColor color) {
-	//߶εBresenham㷨ʵ
-	bool steep = false;
-	steep = (std::abs(x0 - x1) < std::abs(y0 - y1));
-	if (steep) {
-		std::swap(x0, y0);
-		std::swap(x1, y1);
-	}
-	if(x0 > x1) {
-		std::swap(x0, x1);
-		std::swap(y0, y1);
-	}
-
-	int dx = x1 - x0;
-	int dy = std::abs(y1 - y0);
-	int error = 0;
-	int ystep = (y0 < y1) ? 1 : -1;
-	int y = y0;
-
-	for (int x = x0; x <= x1; x++) {
-		if (steep) {
-			framebuffer.set(y, x, color);
-		} else {
-			framebuffer.set(x, y, color);
-		}
+const char* const USAGE =
+	" [model.obj] [--width N] [--height N] [--frames N] [--threads N]"
+	" [--mode fill|wireframe|outline] [--output FILE] [--format tga|tga-raw|none] [--processes N] [--stats] [--trace FILE]";
 
-		error += dy;
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
 
-		if (error * 2 >= dx) {
-			y += ystep;
-			error -= dx;
-		}
+//JSON ַֻת·ֵַܳ
+std::string json_string(const std::string& s) {
+	std::string out = "\"";
+	for (char c : s) {
+		if (c == '"' || c == '\\') out += '\\';
+		out += c;
 	}
+	return out + "\"";
 }
 
-//worh: width or height
-int project(float pos, int worh) {
-	int screen_pos = static_cast<int>((pos + 1.0f) * worh / 2.0f);
-	return screen_pos;
 }
 
-void loadModelOutline(Model model, TGAImage& framebuffer, int height, int width) {
-	//ģƵframebuffer
-	int num_faces = model.nfaces();
-	int num_verts = model.nverts();
-	std::vector<Edge> unique_edges;
-	unique_edges.reserve(num_faces * 3);
-
-	for (int i = 0; i < num_faces; i++) {
-		for (int j = 0; j < 3; j++) {
-			int v0_idx = model.vert_idx(i, j % 3);
-			int v1_idx = model.vert_idx(i, (j + 1) % 3);
-			if (v0_idx > v1_idx) std::swap(v0_idx, v1_idx);
-			Edge edge = { v0_idx, v1_idx };
-			unique_edges.push_back(edge);
+int main(int argc, char** argv) {
+	Options options;
+	for (int i = 1; i < argc; i++) {
+		std::string arg = argv[i];
+		auto value = [&]() -> std::string {
+			if (i + 1 >= argc) {
+				std::cerr << "missing value for " << arg << std::endl;
+				std::exit(1);
+			}
+			return argv[++i];
+		};
+		if (arg == "--width") options.width = std::atoi(value().c_str());
+		else if (arg == "--height") options.height = std::atoi(value().c_str());
+		else if (arg == "--frames") options.frames = std::atoi(value().c_str());
+		else if (arg == "--threads") options.threads = std::atoi(value().c_str());
+		else if (arg == "--mode") options.mode = value();
+		else if (arg == "--output") options.output = value();
+		else if (arg == "--format") options.format = value();
+		else if (arg == "--processes") options.processes = std::atoi(value().c_str());
+		else if (arg == "--stats") options.stats = true;
+		else if (arg == "--trace") options.trace_path = value();
+		else if (arg.size() > 0 && arg[0] != '-') options.model_path = arg;
+		else {
+			std::cerr << "usage: " << argv[0] << USAGE << std::endl;
+			return 1;
 		}
 	}
-
-	std::sort(unique_edges.begin(), unique_edges.end());
-	auto last = std::unique(unique_edges.begin(), unique_edges.end());
-	unique_edges.erase(last, unique_edges.end());
-
-
-	std::vector<Vec2i> screen_coords(num_verts);
-
-
-
-	for (int i = 0; i < num_verts; i++) {
-		Vec3f v = model.vert(i);
-		screen_coords[i].x = project(v.x, width);
-		screen_coords[i].y = project(v.y, height);
+	bool valid_mode = options.mode == "fill" || options.mode == "wireframe" || options.mode == "outline";
+	bool valid_format = options.format == "tga" || options.format == "tga-raw" || options.format == "none";
+	if (options.width <= 0 || options.height <= 0 || options.frames <= 0 || options.threads < 0 || options.processes < 0 || !valid_mode || !valid_format) {
+		std::cerr << "usage: " << argv[0] << USAGE << std::endl;
+		return 1;
 	}
-
-
-	for (const auto& edge : unique_edges) {
-
-
-		Vec2i p0 = screen_coords[edge.u];
-		Vec2i p1 = screen_coords[edge.v];
-
-		// 򵥵Ĳü飨ѡֹ
-		// if (p0.x < 0 || p0.x >= width || p0.y < 0 ...) continue;
-
-		draw_line(p0.x, p0.y, p1.x, p1.y, framebuffer, red);
+	//߳Ҫڵһʹ JobSystem (ģ) ֮ǰȷ
+	if (options.threads > 0) JobSystem::configure(options.threads);
+	const int width = options.width;
+	const int height = options.height;
+	const long long frame_pixels = static_cast<long long>(width) * height;
+
+	auto load_start = std::chrono::steady_clock::now();
+	Model model(options.model_path);
+	double load_ms = elapsed_ms(load_start);
+	if (model.nfaces() == 0) {
+		std::cerr << "ģΪջ޷ȡ: " << options.model_path << std::endl;
+		return 1;
 	}
 
-
-	framebuffer.write_tga_file("framebuffer.tga");
-}
-
-double signed_triangle_area(int ax, int ay, int bx, int by, int cx, int cy) {
-	return .5 * ((by - ay) * (bx + ax) + (cy - by) * (cx + bx) + (ay - cy) * (ax + cx));
-}
-
-void triangle(int ax, int ay, int bx, int by, int cx, int cy, TGAImage& framebuffer, TGAColor color) {
-	int bboxmin_x = std::min({ ax, bx, cx });
-	int bboxmax_x = std::max({ ax, bx, cx });
-	int bboxmin_y = std::min({ ay, by, cy });
-	int bboxmax_y = std::max({ ay, by, cy });
-	double total_area = signed_triangle_area(ax, ay, bx, by, cx, cy);
-	if (total_area < 1)return;
-#pragma omp parallel for
-	for(int x = bboxmax_x; x >= bboxmin_x; x--) {
-		for(int y = bboxmax_y; y >= bboxmin_y; y--) {
-			double alpha = signed_triangle_area(x, y, bx, by, cx, cy) / total_area;
-			if (alpha < 0)continue;
-
-			double beta = signed_triangle_area(ax, ay, x, y, cx, cy) / total_area;
-			if (beta < 0)continue;
-
-			double gamma = signed_triangle_area(ax, ay, bx, by, x, y) / total_area;
-			if (gamma < 0)continue;
-
-			framebuffer.set(x, y, color);
-			
+	//ÿ֡ʱfill ģʽһĸ֡ɣʱƽÿһ֡
+	std::vector<double> frame_ms;
+	frame_ms.reserve(options.frames);
+	auto render_start = std::chrono::steady_clock::now();
+
+	TGAImage framebuffer(width, height, TGAImage::RGB);
+	std::vector<TGAImage> framebuffers;
+	SortFirstStats sort_first;
+	std::unique_ptr<SharedFramebuffer> shared;
+	if (options.mode == "fill" && options.processes > 0) {
+		//: һֺ֮֡ÿ֡ͬһ fork ֱ̣дڴ
+		shared = std::make_unique<SharedFramebuffer>(width, height, TGAImage::RGB);
+		std::vector<TGAColor> colors(model.nfaces());
+		for (int i = 0; i < model.nfaces(); i++) colors[i] = face_color(i);
+		SortFirstOptions sort_options;
+		sort_options.processes = options.processes;
+		sort_options.threads = options.threads;
+		for (int f = 0; f < options.frames; f++) {
+			auto frame_start = std::chrono::steady_clock::now();
+			if (!render_sort_first(model, colors, *shared, sort_options, &sort_first)) {
+				std::cerr << "Ⱦʧ" << std::endl;
+				return 1;
+			}
+			frame_ms.push_back(elapsed_ms(frame_start));
 		}
 	}
-}
-
-int main(int argc, char** argv) {
-	
-
-    constexpr int width  = 800;
-    constexpr int height = 800;
-    TGAImage framebuffer(width, height, TGAImage::RGB);
-	const int LOOP_TIMES = 1000;
-	
-
-	//Ըĳɴвģ·
-    Model model("F:/VSproject/TinyRenderer/obj/diablo3_pose/diablo3_pose.obj");
-	//loadModelOutline(model, framebuffer, height, width);
-	auto start_time = std::chrono::steady_clock::now();
-
-	for (int i = 0; i < LOOP_TIMES; i++) {
-
-		for (int i = 0; i < model.nfaces(); i++) {
-			Vec3f v0 = model.vert(model.vert_idx(i, 0));
-			Vec3f v1 = model.vert(model.vert_idx(i, 1));
-			Vec3f v2 = model.vert(model.vert_idx(i, 2));
-			int ax = project(v0.x, width);
-			int ay = project(v0.y, height);
-			int bx = project(v1.x, width);
-			int by = project(v1.y, height);
-			int cx = project(v2.x, width);
-			int cy = project(v2.y, height);
-			TGAColor rnd;
-
-			for (int c = 0; c < 3; c++) rnd[c] = std::rand() % 255;
-
-			triangle(ax, ay, bx, by, cx, cy, framebuffer, rnd);
+	else if (options.mode == "fill") {
+		//ͬһӽȾ frames ֡ÿ֡߳֡дԵ framebuffer
+		BatchRenderer renderer(model);
+		int batch_size = std::min(options.frames, JobSystem::instance().nthreads());
+		std::vector<View> views(batch_size, View{ Mat4f(), width, height });
+		for (int done = 0; done < options.frames; done += static_cast<int>(views.size())) {
+			views.resize(std::min(batch_size, options.frames - done));
+			auto batch_start = std::chrono::steady_clock::now();
+			renderer.render(views, framebuffers);
+			FrameArena::end_frame();
+			double batch_ms = elapsed_ms(batch_start);
+			for (std::size_t k = 0; k < views.size(); k++) frame_ms.push_back(batch_ms / views.size());
+			//һ trace һ֡overdraw һ framebuffer ƽ
+			profile_end_frame(static_cast<long long>(views.size()) * frame_pixels);
 		}
 	}
+	else {
+		//߿ֻһ framebufferÿ֡ػ
+		//ߵڽӹϵģͼʱѾãﲻؽ
+		for (int f = 0; f < options.frames; f++) {
+			auto frame_start = std::chrono::steady_clock::now();
+			framebuffer.clear();
+			if (options.mode == "wireframe") draw_wireframe(model, Mat4f(), framebuffer, white);
+			else draw_outline(model, Mat4f(), framebuffer, red);
+			FrameArena::end_frame();
+			frame_ms.push_back(elapsed_ms(frame_start));
+			profile_end_frame(frame_pixels);
+		}
+	}
+	double render_ms = elapsed_ms(render_start);
+	const TGAImage& image = shared ? shared->image() : options.mode == "fill" ? framebuffers[0] : framebuffer;
+
+	auto write_start = std::chrono::steady_clock::now();
+	bool written = true;
+	if (options.format != "none") written = image.write_tga_file(options.output, true, options.format == "tga");
+	double write_ms = elapsed_ms(write_start);
+
+	bool traced = false;
+	if (!options.trace_path.empty()) {
+		traced = profile_write_trace(options.trace_path);
+		if (!traced && !PROFILE_ENABLED) std::cerr << "--trace Ҫ -Dprofile=ON Ѻ" << std::endl;
+	}
 
-
-	framebuffer.write_tga_file("Triangle.tga");
-
-	auto end_time = std::chrono::steady_clock::now();
-	auto duration_ms = std::chrono::duration_cast<std::chrono::milliseconds>(end_time - start_time).count();
-	auto duration_s = std::chrono::duration_cast<std::chrono::seconds>(end_time - start_time).count();
-	std::cout << "ɣ" << std::endl;
-	std::cout << "ʱ䣺" << duration_ms << " " << std::endl;
-	std::cout << "ʱ䣺" << duration_s << " " << std::endl;
-	
-
-    return 0;
+	std::vector<double> sorted = frame_ms;
+	std::sort(sorted.begin(), sorted.end());
+	double mean = 0;
+	for (double ms : sorted) mean += ms;
+	mean /= sorted.size();
+	double median = sorted.size() % 2 ? sorted[sorted.size() / 2] : (sorted[sorted.size() / 2 - 1] + sorted[sorted.size() / 2]) / 2;
+	double fps = render_ms > 0 ? options.frames * 1000.0 / render_ms : 0.0;
+
+	if (options.stats) {
+		std::cout << "{\"model\":" << json_string(options.model_path)
+			<< ",\"vertices\":" << model.nverts() << ",\"faces\":" << model.nfaces()
+			<< ",\"width\":" << width << ",\"height\":" << height
+			<< ",\"frames\":" << options.frames << ",\"threads\":" << JobSystem::instance().nthreads()
+			<< ",\"processes\":" << std::max(1, static_cast<int>(sort_first.bands.size()))
+			<< ",\"mode\":" << json_string(options.mode) << ",\"format\":" << json_string(options.format)
+			<< ",\"output\":" << (options.format == "none" ? std::string("null") : json_string(options.output))
+			<< ",\"load_ms\":" << load_ms << ",\"render_ms\":" << render_ms << ",\"write_ms\":" << write_ms
+			<< ",\"frame_ms\":{\"mean\":" << mean << ",\"median\":" << median
+			<< ",\"min\":" << sorted.front() << ",\"max\":" << sorted.back() << "}"
+			<< ",\"fps\":" << fps;
+		if (shared) {
+			//һ̵֡ĺͺʱ
+			std::cout << ",\"numa_nodes\":" << sort_first.numa_nodes << ",\"bands\":[";
+			for (std::size_t i = 0; i < sort_first.bands.size(); i++) {
+				const SortFirstBand& band = sort_first.bands[i];
+				std::cout << (i ? "," : "") << "{\"y0\":" << band.y0 << ",\"y1\":" << band.y1 << ",\"node\":" << band.node
+					<< ",\"threads\":" << band.threads << ",\"ms\":" << band.ms << "}";
+			}
+			std::cout << "]";
+		}
+		if constexpr (PROFILE_ENABLED) {
+			ProfileCounters counters = profile_counters();
+			std::cout << ",\"counters\":{\"triangles_in\":" << counters[PROFILE_TRIANGLES_IN]
+				<< ",\"triangles_out\":" << counters[PROFILE_TRIANGLES_OUT]
+				<< ",\"pixels_tested\":" << counters[PROFILE_PIXELS_TESTED]
+				<< ",\"pixels_written\":" << counters[PROFILE_PIXELS_WRITTEN]
+				<< ",\"lines\":" << counters[PROFILE_LINES] << ",\"line_pixels\":" << counters[PROFILE_LINE_PIXELS] << "}";
+		}
+		std::cout << "}" << std::endl;
+	}
+	else {
+		std::cout << "ɣ" << std::endl;
+		std::cout << "ģͼأ" << load_ms << " " << std::endl;
+		std::cout << "Ⱦ " << options.frames << " ֡" << render_ms << "  (ÿ֡λ " << median << " )" << std::endl;
+		if (options.format != "none") std::cout << "д " << options.output << "" << write_ms << " " << std::endl;
+		if constexpr (PROFILE_ENABLED) {
+			ProfileCounters counters = profile_counters();
+			std::cout << ": " << counters[PROFILE_TRIANGLES_OUT] << " / " << counters[PROFILE_TRIANGLES_IN]
+				<< "  : " << counters[PROFILE_PIXELS_WRITTEN] << " / " << counters[PROFILE_PIXELS_TESTED] << std::endl;
+		}
+		if (traced) std::cout << "trace д " << options.trace_path << std::endl;
+	}
+	return written ? 0 : 1;
 }
-
@@ -3,62 +3,168 @@
 #include <vector>
 #include <fstream>
 #include <sstream>
+#include <algorithm>
+#include <iterator>
 #include "../include/model.h"
+#include "../include/job_system.h"
+#include "../include/profile.h"
 
+//Ϣд׼󣬱׼ --stats  JSON
 void Log(const std::string& message) {
-	std::cout << message << std::endl;
+	std::cerr << message << std::endl;
+}
+
+namespace {
+
+constexpr std::size_t PARSE_CHUNK_BYTES = 1 << 20;	//ÿԼ 1MB ı
+
+struct ParsedChunk {
+	std::vector<Vec3f> verts;
+	std::vector<std::vector<int>> faces;
+};
+
+void parse_line(const std::string& line, ParsedChunk& out) {
+	std::istringstream iss(line);
+	std::string type;
+	iss >> type;
+
+	if (type == "v") {
+		float x, y, z;
+		iss >> x >> y >> z;
+		out.verts.push_back(Vec3f(x, y, z));
+	}
+	else if (type == "f") {
+		//blenderĵʽ f  v/vt/vn
+		std::vector<int> face_indices;
+		int idx;
+		char trash; //Եб
+
+		while (iss >> idx) {
+			idx--;
+			face_indices.push_back(idx);
+
+			if(iss.peek() == '/') {
+				iss >> trash;
+				if (iss.peek() != '/') {
+					//vt
+					int vt;
+					iss >> vt;
+				}
+
+				if (iss.peek() == '/') {
+					iss >> trash;
+					//
+					int vn;
+					iss >> vn;
+				}
+			}
+		}
+		out.faces.push_back(face_indices);
+	}
+}
+
 }
 
 Model::Model(const std::string& filename) {
+	PROFILE_SCOPE("Model::load");
 	std::ifstream in;
-	in.open(filename);
+	in.open(filename, std::ios::binary);
 
 	if (!in.is_open()) {
 		Log("Cannot open file: " + filename);
 		return;
 	}
 
-	std::string line;
-	while (!in.eof()) {
-		std::getline(in, line);
-		std::istringstream iss(line);
-		std::string type;
-		iss >> type;
-
-		if (type == "v") {
-			float x, y, z;
-			iss >> x >> y >> z;
-			verts.push_back(Vec3f(x, y, z));
-		}
-		else if (type == "f") {
-			//blenderĵʽ f  v/vt/vn
-			std::vector<int> face_indices;
-			int idx;
-			char trash; //Եб
+	std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
 
-			while (iss >> idx) {
-				idx--;
-				face_indices.push_back(idx);
+	//б߽ļгɿ鲢нOBJǾԵģԸ黥˳ƴӼ
+	std::vector<std::size_t> bounds = { 0 };
+	while (bounds.back() < text.size()) {
+		std::size_t next = std::min(text.size(), bounds.back() + PARSE_CHUNK_BYTES);
+		next = text.find('\n', next);
+		bounds.push_back(next == std::string::npos ? text.size() : next + 1);
+	}
+	int nchunks = static_cast<int>(bounds.size()) - 1;
+	std::vector<ParsedChunk> chunks(nchunks);
 
-				if(iss.peek() == '/') {
-					iss >> trash;
-					if (iss.peek() != '/') {
-						//vt
-						int vt;
-						iss >> vt;
-					}
-
-					if (iss.peek() == '/') {
-						iss >> trash;
-						//
-						int vn;
-						iss >> vn;
-					}
-				}
+	JobSystem::instance().parallel_for(0, nchunks, 1, [&](int lo, int hi) {
+		std::string line;
+		for (int c = lo; c < hi; c++) {
+			std::size_t pos = bounds[c];
+			while (pos < bounds[c + 1]) {
+				std::size_t eol = text.find('\n', pos);
+				if (eol == std::string::npos || eol > bounds[c + 1]) eol = bounds[c + 1];
+				line.assign(text, pos, eol - pos);
+				parse_line(line, chunks[c]);
+				pos = eol + 1;
 			}
-			faces.push_back(face_indices);
 		}
-		else continue;
+	});
+
+	std::size_t num_verts = 0, num_faces = 0;
+	for (const auto& chunk : chunks) {
+		num_verts += chunk.verts.size();
+		num_faces += chunk.faces.size();
+	}
+	verts.reserve(num_verts);
+	faces.reserve(num_faces);
+	for (auto& chunk : chunks) {
+		verts.insert(verts.end(), chunk.verts.begin(), chunk.verts.end());
+		for (auto& face : chunk.faces) faces.push_back(std::move(face));
+	}
+
+	if (!verts.empty()) bmin = bmax = verts[0];
+	for (const auto& v : verts) {
+		bmin = Vec3f(std::min(bmin.x, v.x), std::min(bmin.y, v.y), std::min(bmin.z, v.z));
+		bmax = Vec3f(std::max(bmax.x, v.x), std::max(bmax.y, v.y), std::max(bmax.z, v.z));
+	}
+}
+
+void Model::build_edges(std::vector<MeshEdge>& out) const {
+	PROFILE_SCOPE("Model::build_edges");
+	//ÿÿ߼һ (С, 󶥵, )ͬı߰һ
+	struct FaceEdge {
+		int v0, v1, face;
+		bool operator<(const FaceEdge& other) const {
+			if (v0 != other.v0) return v0 < other.v0;
+			if (v1 != other.v1) return v1 < other.v1;
+			return face < other.face;
+		}
+	};
+	std::vector<FaceEdge> face_edges;
+	face_edges.reserve(faces.size() * 3);
+	for (int i = 0; i < nfaces(); i++) {
+		int n = static_cast<int>(faces[i].size());
+		for (int j = 0; j < n; j++) {
+			int a = faces[i][j];
+			int b = faces[i][(j + 1) % n];
+			if (a == b) continue;
+			face_edges.push_back({ std::min(a, b), std::max(a, b), i });
+		}
+	}
+	std::sort(face_edges.begin(), face_edges.end());
+
+	//ȥغı߱һη䵽λ
+	std::size_t num_edges = 0;
+	for (std::size_t k = 0; k < face_edges.size(); k++) {
+		if (k == 0 || face_edges[k].v0 != face_edges[k - 1].v0 || face_edges[k].v1 != face_edges[k - 1].v1) num_edges++;
+	}
+	out.clear();
+	out.reserve(num_edges);
+	for (std::size_t first = 0; first < face_edges.size();) {
+		std::size_t last = first + 1;
+		while (last < face_edges.size() && face_edges[last].v0 == face_edges[first].v0 && face_edges[last].v1 == face_edges[first].v1) last++;
+
+		MeshEdge edge;
+		edge.v[0] = face_edges[first].v0;
+		edge.v[1] = face_edges[first].v1;
+		edge.face[0] = face_edges[first].face;
+		edge.face[1] = last - first > 1 ? face_edges[first + 1].face : -1;
+		if (last - first > 2) edge.cos_dihedral = -1.0f;
+		else if (edge.face[1] < 0) edge.cos_dihedral = 1.0f;
+		else edge.cos_dihedral = face_normal(edge.face[0]).dot(face_normal(edge.face[1]));
+		out.push_back(edge);
+		first = last;
 	}
 }
 
@@ -82,3 +188,42 @@ int Model::vert_idx(const int iface, const int jvert) const{
 	return faces[iface][jvert];
 }
 
+Vec3f Model::bbox_min() const {
+	return bmin;
+}
+
+Vec3f Model::bbox_max() const {
+	return bmax;
+}
+
+const std::vector<MeshEdge>& Model::edges() const {
+	EdgeCache& cache = *edge_cache;
+	std::call_once(cache.once, [&] {
+		build_edges(cache.list);
+		cache.built.store(true, std::memory_order_release);
+	});
+	return cache.list;
+}
+
+Vec3f Model::face_normal(const int iface) const {
+	if (faces[iface].size() < 3) return Vec3f(0, 0, 0);
+	Vec3f a = vert(iface, 0);
+	return (vert(iface, 1) - a).cross(vert(iface, 2) - a).normalize();
+}
+
+std::size_t Model::geometry_bytes() const {
+	//ÿǵ vectorԪر vector ͷһζѷĲǿ (16ֽ)
+	constexpr std::size_t HEAP_OVERHEAD = 16;
+	std::size_t bytes = sizeof(*this) + verts.capacity() * sizeof(Vec3f) + faces.capacity() * sizeof(std::vector<int>);
+	for (const auto& face : faces) bytes += face.capacity() * sizeof(int) + HEAP_OVERHEAD;
+	return bytes;
+}
+
+std::size_t Model::edge_bytes() const {
+	if (!edge_cache->built.load(std::memory_order_acquire)) return 0;
+	return sizeof(EdgeCache) + edge_cache->list.capacity() * sizeof(MeshEdge);
+}
+
+std::size_t Model::memory_bytes() const {
+	return geometry_bytes() + edge_bytes();
+}
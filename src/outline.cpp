@@ -0,0 +1,133 @@
+#include <algorithm>
+#include <cmath>
+#include "../include/outline.h"
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+#include "../include/profile.h"
+
+OutlineStats extract_outline(const Model& model, const Mat4f& transform, const OutlineOptions& options, std::span<const int>& edge_ids) {
+	PROFILE_SCOPE("extract_outline");
+	JobSystem& jobs = JobSystem::instance();
+	FrameArena& arena = FrameArena::local();
+	const std::vector<MeshEdge>& edges = model.edges();
+	int num_verts = model.nverts();
+	int num_faces = model.nfaces();
+	int num_edges = static_cast<int>(edges.size());
+
+	OutlineStats stats;
+	stats.edges_total = num_edges;
+
+	//1. 逐面朝向，只有要找轮廓边时才需要
+	std::span<char> front;
+	if (options.kinds & OUTLINE_SILHOUETTE) {
+		std::span<Vec3f> ndc = arena.alloc<Vec3f>(num_verts);
+		jobs.parallel_for(0, num_verts, 4096, [&](int lo, int hi) {
+			for (int i = lo; i < hi; i++) ndc[i] = transform.transform_point(model.vert(i));
+		});
+		front = arena.alloc<char>(num_faces);
+		jobs.parallel_for(0, num_faces, 4096, [&](int lo, int hi) {
+			for (int i = lo; i < hi; i++) {
+				const Vec3f& a = ndc[model.vert_idx(i, 0)];
+				const Vec3f& b = ndc[model.vert_idx(i, 1)];
+				const Vec3f& c = ndc[model.vert_idx(i, 2)];
+				front[i] = (b.x - a.x) * (c.y - a.y) - (b.y - a.y) * (c.x - a.x) > 0.0f;
+			}
+		});
+	}
+
+	//2. 逐边分类，每块先数出保留的边数，前缀和之后各块写到自己的位置，保持边的原顺序
+	constexpr int CLASSIFY_GRAIN = 8192;
+	const float crease_cos = std::cos(options.crease_angle * 3.14159265f / 180.0f);
+	int num_chunks = std::max(1, (num_edges + CLASSIFY_GRAIN - 1) / CLASSIFY_GRAIN);
+	std::span<unsigned char> kinds = arena.alloc<unsigned char>(num_edges);
+	std::span<OutlineStats> chunk_stats = arena.alloc_filled<OutlineStats>(num_chunks, OutlineStats());
+
+	jobs.parallel_for(0, num_chunks, 1, [&](int lo, int hi) {
+		for (int c = lo; c < hi; c++) {
+			OutlineStats& local = chunk_stats[c];
+			int last = std::min(num_edges, (c + 1) * CLASSIFY_GRAIN);
+			for (int e = c * CLASSIFY_GRAIN; e < last; e++) {
+				const MeshEdge& edge = edges[e];
+				unsigned kind = 0;
+				if (edge.face[1] < 0) {
+					if (options.kinds & OUTLINE_BOUNDARY) {
+						local.boundary++;
+						kind |= OUTLINE_BOUNDARY;
+					}
+				}
+				else {
+					if ((options.kinds & OUTLINE_SILHOUETTE) && front[edge.face[0]] != front[edge.face[1]]) {
+						local.silhouette++;
+						kind |= OUTLINE_SILHOUETTE;
+					}
+					if ((options.kinds & OUTLINE_CREASE) && edge.cos_dihedral < crease_cos) {
+						local.crease++;
+						kind |= OUTLINE_CREASE;
+					}
+				}
+				kinds[e] = static_cast<unsigned char>(kind);
+				if (kind) local.drawn++;
+			}
+		}
+	});
+
+	std::span<int> chunk_start = arena.alloc<int>(num_chunks);
+	for (int c = 0; c < num_chunks; c++) {
+		chunk_start[c] = stats.drawn;
+		stats.silhouette += chunk_stats[c].silhouette;
+		stats.crease += chunk_stats[c].crease;
+		stats.boundary += chunk_stats[c].boundary;
+		stats.drawn += chunk_stats[c].drawn;
+	}
+
+	std::span<int> ids = arena.alloc<int>(stats.drawn);
+	jobs.parallel_for(0, num_chunks, 1, [&](int lo, int hi) {
+		for (int c = lo; c < hi; c++) {
+			int next = chunk_start[c];
+			int last = std::min(num_edges, (c + 1) * CLASSIFY_GRAIN);
+			for (int e = c * CLASSIFY_GRAIN; e < last; e++)
+				if (kinds[e]) ids[next++] = e;
+		}
+	});
+	edge_ids = ids;
+	return stats;
+}
+
+namespace {
+
+//投影 edges[edge_id(i)] 的两个端点并用 draw_lines 画出，endpoints 分配在调用者的 ArenaScope 里
+template<class EdgeId>
+void draw_edges(const Model& model, const Mat4f& transform, int num_lines, EdgeId edge_id, TGAImage& framebuffer, TGAColor color) {
+	int width = framebuffer.width();
+	int height = framebuffer.height();
+	const std::vector<MeshEdge>& edges = model.edges();
+	std::span<Vec2i> endpoints = FrameArena::local().alloc<Vec2i>(2 * static_cast<std::size_t>(num_lines));
+	JobSystem::instance().parallel_for(0, num_lines, 4096, [&](int lo, int hi) {
+		for (int i = lo; i < hi; i++) {
+			for (int j = 0; j < 2; j++) {
+				Vec3f v = transform.transform_point(model.vert(edges[edge_id(i)].v[j]));
+				endpoints[2 * i + j] = Vec2i(project(v.x, width), project(v.y, height));
+			}
+		}
+	});
+	draw_lines(endpoints, framebuffer, color);
+}
+
+}
+
+OutlineStats draw_outline(const Model& model, const Mat4f& transform, TGAImage& framebuffer, TGAColor color,
+	const OutlineOptions& options) {
+	ArenaScope arena;
+	std::span<const int> edge_ids;
+	OutlineStats stats = extract_outline(model, transform, options, edge_ids);
+
+	draw_edges(model, transform, static_cast<int>(edge_ids.size()), [&](int i) { return edge_ids[i]; }, framebuffer, color);
+	return stats;
+}
+
+int draw_wireframe(const Model& model, const Mat4f& transform, TGAImage& framebuffer, TGAColor color) {
+	ArenaScope arena;
+	int num_lines = static_cast<int>(model.edges().size());
+	draw_edges(model, transform, num_lines, [](int i) { return i; }, framebuffer, color);
+	return num_lines;
+}
@@ -0,0 +1,176 @@
+#include "../include/profile.h"
+
+#ifdef TINYRENDERER_PROFILE
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+const char* const COUNTER_NAMES[PROFILE_COUNTER_COUNT] = {
+	"triangles_in", "triangles_out", "pixels_tested", "pixels_written", "lines", "line_pixels",
+};
+
+struct TraceEvent {
+	const char* name;
+	long long start;		//纳秒，相对进程开始
+	long long duration;
+	int tid;
+};
+
+struct FrameRecord {
+	long long time;
+	ProfileCounters delta;		//这一帧的计数
+	double overdraw;
+};
+
+const auto epoch = std::chrono::steady_clock::now();
+
+long long now_ns() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+struct ThreadData;
+
+//所有线程的数据；线程退出时把它的时间段和计数并入 retired，不会丢
+//工作线程在 JobSystem 析构时才退出，可能晚于本文件的静态对象析构，所以 Registry 故意不释放
+struct Registry {
+	std::mutex mutex;
+	std::vector<ThreadData*> threads;
+	std::vector<TraceEvent> retired_events;
+	ProfileCounters retired_counters;
+	ProfileCounters last_frame_totals;
+	std::vector<FrameRecord> frames;
+	int next_tid = 0;
+};
+
+Registry& registry() {
+	static Registry* r = new Registry;
+	return *r;
+}
+
+struct ThreadData {
+	int tid;
+	ProfileCounters counters;
+	std::vector<TraceEvent> events;
+
+	ThreadData() {
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		tid = r.next_tid++;
+		events.reserve(4096);
+		r.threads.push_back(this);
+	}
+	~ThreadData() {
+		Registry& r = registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.retired_events.insert(r.retired_events.end(), events.begin(), events.end());
+		for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) r.retired_counters.value[c] += counters.value[c];
+		r.threads.erase(std::find(r.threads.begin(), r.threads.end(), this));
+	}
+};
+
+ThreadData& thread_data() {
+	thread_local ThreadData data;
+	return data;
+}
+
+ProfileCounters totals_locked(const Registry& r) {
+	ProfileCounters total = r.retired_counters;
+	for (const ThreadData* data : r.threads)
+		for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) total.value[c] += data->counters.value[c];
+	return total;
+}
+
+}
+
+void profile_add(ProfileCounter counter, long long n) {
+	thread_data().counters.value[counter] += n;
+}
+
+ProfileScope::ProfileScope(const char* name) : name(name), start(now_ns()) {}
+
+ProfileScope::~ProfileScope() {
+	ThreadData& data = thread_data();
+	data.events.push_back({ name, start, now_ns() - start, data.tid });
+}
+
+ProfileCounters profile_counters() {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	return totals_locked(r);
+}
+
+void profile_end_frame(long long frame_pixels) {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	ProfileCounters total = totals_locked(r);
+	FrameRecord frame;
+	frame.time = now_ns();
+	for (int c = 0; c < PROFILE_COUNTER_COUNT; c++) frame.delta.value[c] = total.value[c] - r.last_frame_totals.value[c];
+	frame.overdraw = frame_pixels > 0 ? static_cast<double>(frame.delta[PROFILE_PIXELS_WRITTEN]) / frame_pixels : 0.0;
+	r.frames.push_back(frame);
+	r.last_frame_totals = total;
+}
+
+bool profile_write_trace(const std::string& path) {
+	std::ofstream out(path);
+	if (!out.is_open()) return false;
+
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	std::vector<TraceEvent> events = r.retired_events;
+	for (const ThreadData* data : r.threads) events.insert(events.end(), data->events.begin(), data->events.end());
+	std::sort(events.begin(), events.end(), [](const TraceEvent& a, const TraceEvent& b) { return a.start < b.start; });
+
+	//trace_event 的时间单位是微秒，保留到纳秒
+	out << std::fixed << std::setprecision(3);
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+	bool first = true;
+	auto separator = [&]() -> std::ofstream& {
+		if (!first) out << ",\n";
+		first = false;
+		return out;
+	};
+	for (const TraceEvent& e : events) {
+		separator() << "{\"name\":\"" << e.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << e.tid
+			<< ",\"ts\":" << e.start / 1000.0 << ",\"dur\":" << e.duration / 1000.0 << "}";
+	}
+	for (std::size_t f = 0; f < r.frames.size(); f++) {
+		const FrameRecord& frame = r.frames[f];
+		double ts = frame.time / 1000.0;
+		separator() << "{\"name\":\"frame " << f << "\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0,\"ts\":" << ts << "}";
+		separator() << "{\"name\":\"triangles\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ts << ",\"args\":{\"in\":"
+			<< frame.delta[PROFILE_TRIANGLES_IN] << ",\"out\":" << frame.delta[PROFILE_TRIANGLES_OUT] << "}}";
+		separator() << "{\"name\":\"pixels\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ts << ",\"args\":{\"tested\":"
+			<< frame.delta[PROFILE_PIXELS_TESTED] << ",\"written\":" << frame.delta[PROFILE_PIXELS_WRITTEN]
+			<< ",\"line\":" << frame.delta[PROFILE_LINE_PIXELS] << "}}";
+		separator() << "{\"name\":\"overdraw\",\"ph\":\"C\",\"pid\":1,\"ts\":" << ts << ",\"args\":{\"overdraw\":"
+			<< frame.overdraw << "}}";
+	}
+	out << "\n],\"otherData\":{";
+	ProfileCounters total = totals_locked(r);
+	for (int c = 0; c < PROFILE_COUNTER_COUNT; c++)
+		out << (c ? "," : "") << "\"" << COUNTER_NAMES[c] << "\":" << total.value[c];
+	out << "}}\n";
+	return static_cast<bool>(out);
+}
+
+void profile_reset() {
+	Registry& r = registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	for (ThreadData* data : r.threads) {
+		data->events.clear();
+		data->counters = ProfileCounters();
+	}
+	r.retired_events.clear();
+	r.retired_counters = ProfileCounters();
+	r.last_frame_totals = ProfileCounters();
+	r.frames.clear();
+}
+
+#endif
@@ -0,0 +1,325 @@
+#include <cmath>
+#include <algorithm>
+#include <deque>
+#include <mutex>
+#include "../include/rasterizer.h"
+#include "../include/job_system.h"
+#include "../include/shader.h"
+#include "../include/compact_model.h"
+
+int project(float pos, int worh) {
+	int screen_pos = static_cast<int>((pos + 1.0f) * worh / 2.0f);
+	return screen_pos;
+}
+
+double signed_triangle_area(int ax, int ay, int bx, int by, int cx, int cy) {
+	return .5 * ((by - ay) * (bx + ax) + (cy - by) * (cx + bx) + (ay - cy) * (ax + cx));
+}
+
+void triangle_clipped(int ax, int ay, int bx, int by, int cx, int cy, int clip_x0, int clip_y0, int clip_x1, int clip_y1, TGAImage& framebuffer, TGAColor color) {
+	const Vec2i p[3] = { Vec2i(ax, ay), Vec2i(bx, by), Vec2i(cx, cy) };
+	const float z[3] = { 0.0f, 0.0f, 0.0f };
+	const FillShader::Varying var[3] = {};
+	RenderTarget target;
+	target.color = &framebuffer;
+	rasterize(FillShader{ color }, -1, p, z, var, target, clip_x0, clip_y0, clip_x1, clip_y1);
+}
+
+void triangle(int ax, int ay, int bx, int by, int cx, int cy, TGAImage& framebuffer, TGAColor color) {
+	const Vec2i p[3] = { Vec2i(ax, ay), Vec2i(bx, by), Vec2i(cx, cy) };
+	const float z[3] = { 0.0f, 0.0f, 0.0f };
+	const FillShader::Varying var[3] = {};
+	RenderTarget target;
+	target.color = &framebuffer;
+	PROFILE_COUNT(PROFILE_TRIANGLES_IN, 1);
+	if (rasterize(FillShader{ color }, -1, p, z, var, target, 0, 0, framebuffer.width() - 1, framebuffer.height() - 1))
+		PROFILE_COUNT(PROFILE_TRIANGLES_OUT, 1);
+}
+
+namespace {
+
+//所有领过的槽；deque 追加时不移动已有元素，线程手里的指针一直有效
+//线程可能晚于本文件的静态对象退出，所以 SlotRegistry 故意不释放
+struct SlotRegistry {
+	std::mutex mutex;
+	std::deque<RasterCounterSlot> slots;
+	std::vector<RasterCounterSlot*> free;
+};
+
+SlotRegistry& slot_registry() {
+	static SlotRegistry* r = new SlotRegistry;
+	return *r;
+}
+
+//线程退出时把槽还回去
+struct SlotLease {
+	RasterCounterSlot* slot = nullptr;
+	~SlotLease() {
+		if (!slot) return;
+		SlotRegistry& r = slot_registry();
+		std::lock_guard<std::mutex> lock(r.mutex);
+		r.free.push_back(slot);
+	}
+};
+
+}
+
+RasterCounterSlot* claim_raster_slot() {
+	thread_local SlotLease lease;
+	if (lease.slot) return lease.slot;
+	SlotRegistry& r = slot_registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	if (!r.free.empty()) {
+		lease.slot = r.free.back();
+		r.free.pop_back();
+	}
+	else {
+		lease.slot = &r.slots.emplace_back();
+	}
+	return lease.slot;
+}
+
+RasterStats raster_stats() {
+	SlotRegistry& r = slot_registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	RasterStats total;
+	for (const auto& slot : r.slots) {
+		total.culled += slot.stats.culled;
+		total.micro += slot.stats.micro;
+		total.full += slot.stats.full;
+	}
+	return total;
+}
+
+void reset_raster_stats() {
+	SlotRegistry& r = slot_registry();
+	std::lock_guard<std::mutex> lock(r.mutex);
+	for (auto& slot : r.slots) slot.stats = RasterStats();
+}
+
+TGAColor face_color(int iface) {
+	std::uint32_t h = static_cast<std::uint32_t>(iface) * 0x9E3779B1u;
+	h ^= h >> 16;
+	h *= 0x85EBCA6Bu;
+	h ^= h >> 13;
+	h *= 0xC2B2AE35u;
+	h ^= h >> 16;
+	TGAColor color;
+	for (int c = 0; c < 3; c++) color[c] = ((h >> (8 * c)) & 0xFF) % 255;
+	return color;
+}
+
+bool triangle_tiles(const Vec2i& a, const Vec2i& b, const Vec2i& c, int width, int height, int& tx0, int& ty0, int& tx1, int& ty1) {
+	int x0 = std::max(std::min({ a.x, b.x, c.x }), 0);
+	int x1 = std::min(std::max({ a.x, b.x, c.x }), width - 1);
+	int y0 = std::max(std::min({ a.y, b.y, c.y }), 0);
+	int y1 = std::min(std::max({ a.y, b.y, c.y }), height - 1);
+	PROFILE_COUNT(PROFILE_TRIANGLES_IN, 1);
+	if (x0 > x1 || y0 > y1 || signed_area2(a.x, a.y, b.x, b.y, c.x, c.y) < 2) {
+		local_raster_stats().culled++;
+		return false;
+	}
+	PROFILE_COUNT(PROFILE_TRIANGLES_OUT, 1);
+	tx0 = x0 / RASTER_TILE_SIZE;
+	tx1 = x1 / RASTER_TILE_SIZE;
+	ty0 = y0 / RASTER_TILE_SIZE;
+	ty1 = y1 / RASTER_TILE_SIZE;
+	return true;
+}
+
+void project_vertices(const Model& model, int width, int height, std::vector<Vec2i>& screen_coords) {
+	PROFILE_SCOPE("project_vertices");
+	int num_verts = model.nverts();
+	screen_coords.resize(num_verts);
+	JobSystem::instance().parallel_for(0, num_verts, 4096, [&](int lo, int hi) {
+		for (int i = lo; i < hi; i++) {
+			Vec3f v = model.vert(i);
+			screen_coords[i] = Vec2i(project(v.x, width), project(v.y, height));
+		}
+	});
+}
+
+void draw_model(const Model& model, TGAImage& framebuffer, const std::vector<TGAColor>& colors) {
+	RenderTarget target;
+	target.color = &framebuffer;
+	draw_mesh(model, FlatShader{ &model, colors.data() }, target);
+}
+
+void draw_model(const CompactModel& model, TGAImage& framebuffer, const std::vector<TGAColor>& colors) {
+	RenderTarget target;
+	target.color = &framebuffer;
+	ArenaScope arena;
+	DequantizedMesh mesh(model, *arena);
+	draw_mesh(mesh, BasicFlatShader{ &mesh, colors.data() }, target);
+}
+
+namespace {
+
+//draw_line 的 Bresenham 规范化形式: steep 时交换 xy，使主轴 (这里叫 x) 递增且 0 <= dy <= dx
+struct LineSetup {
+	bool steep;
+	int x0, y0;
+	int dx, dy;
+	int ystep;
+};
+
+LineSetup setup_line(int x0, int y0, int x1, int y1) {
+	LineSetup line;
+	line.steep = std::abs(x0 - x1) < std::abs(y0 - y1);
+	if (line.steep) {
+		std::swap(x0, y0);
+		std::swap(x1, y1);
+	}
+	if (x0 > x1) {
+		std::swap(x0, x1);
+		std::swap(y0, y1);
+	}
+	line.x0 = x0;
+	line.y0 = y0;
+	line.dx = x1 - x0;
+	line.dy = std::abs(y1 - y0);
+	line.ystep = (y0 < y1) ? 1 : -1;
+	return line;
+}
+
+//Bresenham 第 k 步时副轴已经走了几步，即 floor((2k*dy + dx) / 2dx)
+//误差项始终满足 -dx <= 2*error < dx，由此可以直接算出，不必逐步累加
+long long minor_steps(const LineSetup& line, long long k) {
+	if (line.dx == 0) return 0;
+	return (2 * k * line.dy + line.dx) / (2 * static_cast<long long>(line.dx));
+}
+
+//副轴至少走了 n 步的第一个 k，走不到时返回 dx+1
+long long first_step_reaching(const LineSetup& line, long long n) {
+	if (n <= 0) return 0;
+	if (line.dy == 0) return static_cast<long long>(line.dx) + 1;
+	long long num = (2 * n - 1) * line.dx;
+	long long den = 2 * static_cast<long long>(line.dy);
+	return std::min<long long>((num + den - 1) / den, static_cast<long long>(line.dx) + 1);
+}
+
+//Cohen-Sutherland 区域码
+int outcode(int x, int y, int clip_x0, int clip_y0, int clip_x1, int clip_y1) {
+	return (x < clip_x0 ? 1 : 0) | (x > clip_x1 ? 2 : 0) | (y < clip_y0 ? 4 : 0) | (y > clip_y1 ? 8 : 0);
+}
+
+//把裁剪矩形换算成步数区间 [klo,khi]，裁剪在步数上做，剩下的像素与不裁剪时完全相同
+//主轴是线性的直接截断；副轴随 k 单调，用 first_step_reaching 求端点 (Liang-Barsky 的参数裁剪思路，只是参数换成了整数步数)
+bool clip_steps(const LineSetup& line, int major_lo, int major_hi, int minor_lo, int minor_hi, long long& klo, long long& khi) {
+	klo = std::max(0, major_lo - line.x0);
+	khi = std::min(line.dx, major_hi - line.x0);
+	if (klo > khi) return false;
+
+	long long nlo = line.ystep > 0 ? minor_lo - line.y0 : line.y0 - minor_hi;
+	long long nhi = line.ystep > 0 ? minor_hi - line.y0 : line.y0 - minor_lo;
+	if (nhi < 0 || nlo > nhi) return false;
+	klo = std::max(klo, first_step_reaching(line, nlo));
+	khi = std::min(khi, first_step_reaching(line, nhi + 1) - 1);
+	return klo <= khi;
+}
+
+}
+
+void draw_line_clipped(int x0, int y0, int x1, int y1, int clip_x0, int clip_y0, int clip_x1, int clip_y1, TGAImage& framebuffer, TGAColor color) {
+	clip_x0 = std::max(clip_x0, 0);
+	clip_y0 = std::max(clip_y0, 0);
+	clip_x1 = std::min(clip_x1, framebuffer.width() - 1);
+	clip_y1 = std::min(clip_y1, framebuffer.height() - 1);
+	if (clip_x0 > clip_x1 || clip_y0 > clip_y1) return;
+	//两端在同一侧之外直接丢弃，两端都在内部则不用裁剪
+	int code0 = outcode(x0, y0, clip_x0, clip_y0, clip_x1, clip_y1);
+	int code1 = outcode(x1, y1, clip_x0, clip_y0, clip_x1, clip_y1);
+	if (code0 & code1) return;
+
+	LineSetup line = setup_line(x0, y0, x1, y1);
+	long long klo = 0, khi = line.dx;
+	if (code0 | code1) {
+		bool visible = line.steep ? clip_steps(line, clip_y0, clip_y1, clip_x0, clip_x1, klo, khi)
+			: clip_steps(line, clip_x0, clip_x1, clip_y0, clip_y1, klo, khi);
+		if (!visible) return;
+	}
+
+	//从第 klo 步的误差项接着走 Bresenham，副轴不变的一段是一整行 (或一整列) 连续像素，副轴变化时一次写完
+	long long n = minor_steps(line, klo);
+	long long error = klo * line.dy - n * line.dx;
+	int minor = line.y0 + line.ystep * static_cast<int>(n);
+	int run_start = line.x0 + static_cast<int>(klo);
+	const int major_end = line.x0 + static_cast<int>(khi);
+	for (int major = run_start; major <= major_end; major++) {
+		error += line.dy;
+		if (error * 2 >= line.dx || major == major_end) {
+			PROFILE_COUNT(PROFILE_LINE_PIXELS, major - run_start + 1);
+			if (line.steep) framebuffer.fill_column(minor, run_start, major, color);
+			else framebuffer.fill_row(run_start, major, minor, color);
+			run_start = major + 1;
+		}
+		if (error * 2 >= line.dx) {
+			minor += line.ystep;
+			error -= line.dx;
+		}
+	}
+}
+
+void draw_line(int x0, int y0, int x1, int y1, TGAImage& framebuffer, TGAColor color) {
+	PROFILE_COUNT(PROFILE_LINES, 1);
+	draw_line_clipped(x0, y0, x1, y1, 0, 0, framebuffer.width() - 1, framebuffer.height() - 1, framebuffer, color);
+}
+
+void draw_lines(std::span<const Vec2i> endpoints, TGAImage& framebuffer, TGAColor color) {
+	JobSystem& jobs = JobSystem::instance();
+	const int width = framebuffer.width();
+	const int height = framebuffer.height();
+	PROFILE_SCOPE("draw_lines");
+	const int num_lines = static_cast<int>(endpoints.size() / 2);
+	const int tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	const int tiles_y = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	const int num_tiles = tiles_x * tiles_y;
+	if (num_tiles == 0) return;
+	//只有一个线程时分箱纯属额外开销，直接按顺序画
+	if (jobs.nthreads() == 1) {
+		for (int i = 0; i < num_lines; i++)
+			draw_line(endpoints[2 * i].x, endpoints[2 * i].y, endpoints[2 * i + 1].x, endpoints[2 * i + 1].y, framebuffer, color);
+		return;
+	}
+	PROFILE_COUNT(PROFILE_LINES, num_lines);
+	constexpr int BIN_GRAIN = 4096;
+
+	//分箱: 沿主轴逐个tile带求出线段在该带内的副轴范围，只进入真正经过的tile，而不是整个包围盒
+	ArenaScope arena;
+	TileBins bins = bin_to_tiles(*arena, num_lines, num_tiles, BIN_GRAIN, [&](int i, auto&& emit) {
+		const Vec2i& p0 = endpoints[2 * i];
+		const Vec2i& p1 = endpoints[2 * i + 1];
+		LineSetup line = setup_line(p0.x, p0.y, p1.x, p1.y);
+		int major_size = line.steep ? height : width;
+		int minor_size = line.steep ? width : height;
+		long long klo, khi;
+		if (!clip_steps(line, 0, major_size - 1, 0, minor_size - 1, klo, khi)) return;
+
+		int band0 = (line.x0 + static_cast<int>(klo)) / RASTER_TILE_SIZE;
+		int band1 = (line.x0 + static_cast<int>(khi)) / RASTER_TILE_SIZE;
+		for (int band = band0; band <= band1; band++) {
+			long long k0 = std::max<long long>(klo, band * RASTER_TILE_SIZE - line.x0);
+			long long k1 = std::min<long long>(khi, (band + 1) * RASTER_TILE_SIZE - 1 - line.x0);
+			int m0 = line.y0 + line.ystep * static_cast<int>(minor_steps(line, k0));
+			int m1 = line.y0 + line.ystep * static_cast<int>(minor_steps(line, k1));
+			int t0 = std::min(m0, m1) / RASTER_TILE_SIZE;
+			int t1 = std::max(m0, m1) / RASTER_TILE_SIZE;
+			for (int t = t0; t <= t1; t++) emit(line.steep ? band * tiles_x + t : t * tiles_x + band);
+		}
+	});
+
+	//每个tile只写自己范围内的像素，tile之间互不重叠
+	jobs.parallel_for(0, num_tiles, 1, [&](int lo, int hi) {
+		for (int t = lo; t < hi; t++) {
+			int x0 = (t % tiles_x) * RASTER_TILE_SIZE;
+			int y0 = (t / tiles_x) * RASTER_TILE_SIZE;
+			int x1 = std::min(x0 + RASTER_TILE_SIZE, width) - 1;
+			int y1 = std::min(y0 + RASTER_TILE_SIZE, height) - 1;
+			for (int i : bins.tile(t)) {
+				const Vec2i& p0 = endpoints[2 * i];
+				const Vec2i& p1 = endpoints[2 * i + 1];
+				draw_line_clipped(p0.x, p0.y, p1.x, p1.y, x0, y0, x1, y1, framebuffer, color);
+			}
+		}
+	});
+}
@@ -0,0 +1,283 @@
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#include <string>
+#include <thread>
+#include "../include/sort_first.h"
+#include "../include/rasterizer.h"
+#include "../include/shader.h"
+#include "../include/job_system.h"
+#ifdef __linux__
+#include <cerrno>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+double elapsed_ms(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+//sysfs 的 cpulist 格式，比如 "0-3,8-11"
+std::vector<int> parse_cpulist(const std::string& text) {
+	std::vector<int> cpus;
+	std::size_t pos = 0;
+	while (pos < text.size()) {
+		std::size_t end = text.find(',', pos);
+		if (end == std::string::npos) end = text.size();
+		std::string range = text.substr(pos, end - pos);
+		std::size_t dash = range.find('-');
+		try {
+			int lo = std::stoi(range.substr(0, dash));
+			int hi = dash == std::string::npos ? lo : std::stoi(range.substr(dash + 1));
+			for (int cpu = lo; cpu <= hi; cpu++) cpus.push_back(cpu);
+		}
+		catch (const std::exception&) {}
+		pos = end + 1;
+	}
+	return cpus;
+}
+
+//横带边界的行数粒度: 整tile行，并且 y * row_bytes 落在页边界上 (映射本身按页对齐)，相邻横带不共用页面
+int band_granule(std::size_t row_bytes) {
+	long page = 4096;
+#ifdef __linux__
+	if (long size = sysconf(_SC_PAGESIZE); size > 0) page = size;
+#endif
+	long page_rows = page / std::gcd(page, static_cast<long>(row_bytes));
+	return static_cast<int>(std::lcm(page_rows, static_cast<long>(RASTER_TILE_SIZE)));
+}
+
+//按估计的工作量把画面切成最多 count 条横带，边界对齐到 granule 行 (RASTER_TILE_SIZE 的整数倍)
+//每个tile行的工作量 = 落在这一行的 (三角形, tile) 对数 + 这一行的tile数 (清屏和空tile的固定开销)
+std::vector<SortFirstBand> split_bands(const Model& model, int width, int height, int count, int granule) {
+	const int tiles_x = (width + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	const int tile_rows = (height + RASTER_TILE_SIZE - 1) / RASTER_TILE_SIZE;
+	const int groups = (height + granule - 1) / granule;
+	const int tiles_per_group = granule / RASTER_TILE_SIZE;
+	count = std::max(1, std::min(count, groups));
+
+	std::vector<Vec2i> screen_coords;
+	project_vertices(model, width, height, screen_coords);
+	std::vector<long long> row_cost(tile_rows, tiles_x);
+	for (int i = 0; i < model.nfaces(); i++) {
+		const Vec2i& a = screen_coords[model.vert_idx(i, 0)];
+		const Vec2i& b = screen_coords[model.vert_idx(i, 1)];
+		const Vec2i& c = screen_coords[model.vert_idx(i, 2)];
+		//与 triangle_tiles 的剔除条件相同，但不计入光栅化统计
+		int x0 = std::max(std::min({ a.x, b.x, c.x }), 0);
+		int x1 = std::min(std::max({ a.x, b.x, c.x }), width - 1);
+		int y0 = std::max(std::min({ a.y, b.y, c.y }), 0);
+		int y1 = std::min(std::max({ a.y, b.y, c.y }), height - 1);
+		if (x0 > x1 || y0 > y1 || signed_area2(a.x, a.y, b.x, b.y, c.x, c.y) < 2) continue;
+		int span = x1 / RASTER_TILE_SIZE - x0 / RASTER_TILE_SIZE + 1;
+		for (int ty = y0 / RASTER_TILE_SIZE; ty <= y1 / RASTER_TILE_SIZE; ty++) row_cost[ty] += span;
+	}
+	std::vector<long long> cost(groups, 0);
+	for (int ty = 0; ty < tile_rows; ty++) cost[ty / tiles_per_group] += row_cost[ty];
+
+	long long total = 0;
+	for (long long c : cost) total += c;
+	std::vector<SortFirstBand> bands(count);
+	long long prefix = 0;
+	int group = 0;
+	for (int k = 0; k < count; k++) {
+		bands[k].y0 = group * granule;
+		//至少一组，并给后面的横带每条留一组
+		long long target = total * (k + 1) / count;
+		do prefix += cost[group++];
+		while (group < groups - (count - 1 - k) && prefix < target);
+		if (k == count - 1) group = groups;
+		bands[k].y1 = std::min(group * granule, height) - 1;
+	}
+	return bands;
+}
+
+//工作进程: 清零并画自己的横带
+void render_band(const Model& model, const std::vector<TGAColor>& colors, SharedFramebuffer& framebuffer, const SortFirstBand& band) {
+	TGAImage& image = framebuffer.image();
+	//first-touch: 由本节点的线程第一次写这些页面，内核就把它们分配在本节点的内存上
+	const std::size_t row_bytes = framebuffer.row_bytes();
+	JobSystem::instance().parallel_for(band.y0, band.y1 + 1, RASTER_TILE_SIZE, [&](int lo, int hi) {
+		std::memset(framebuffer.data() + lo * row_bytes, 0, (hi - lo) * row_bytes);
+	});
+
+	RenderTarget target;
+	target.color = &image;
+	target.scissor_y0 = band.y0;
+	target.scissor_y1 = band.y1;
+	draw_mesh(model, FlatShader{ &model, colors.data() }, target);
+}
+
+}
+
+std::vector<std::vector<int>> numa_node_cpus() {
+	std::vector<int> allowed = allowed_cpus();
+
+	//节点编号可能不连续，按编号排序
+	std::vector<std::pair<int, std::vector<int>>> found;
+	std::error_code ec;
+	for (const auto& entry : std::filesystem::directory_iterator("/sys/devices/system/node", ec)) {
+		std::string name = entry.path().filename().string();
+		if (name.rfind("node", 0) != 0 || name.size() == 4 || !std::all_of(name.begin() + 4, name.end(), [](unsigned char ch) { return std::isdigit(ch) != 0; })) continue;
+		std::ifstream in(entry.path() / "cpulist");
+		std::string text;
+		std::getline(in, text);
+		std::vector<int> cpus;
+		for (int cpu : parse_cpulist(text))
+			if (std::binary_search(allowed.begin(), allowed.end(), cpu)) cpus.push_back(cpu);
+		if (!cpus.empty()) found.emplace_back(std::stoi(name.substr(4)), std::move(cpus));
+	}
+	std::sort(found.begin(), found.end());
+
+	std::vector<std::vector<int>> nodes;
+	for (auto& node : found) nodes.push_back(std::move(node.second));
+	if (nodes.empty()) nodes.push_back(allowed);
+	return nodes;
+}
+
+#ifdef __linux__
+
+SharedFramebuffer::SharedFramebuffer(int width, int height, int bpp) {
+	stride = static_cast<std::size_t>(std::max(width, 0)) * bpp;
+	bytes = stride * std::max(height, 0);
+	if (bytes == 0) return;
+	//匿名映射的页面在第一次写入前不占物理内存，也就还没决定落在哪个节点上
+	void* mapping = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (mapping == MAP_FAILED) return;
+	pixels = static_cast<std::uint8_t*>(mapping);
+	view = TGAImage(width, height, bpp, pixels);
+}
+
+SharedFramebuffer::~SharedFramebuffer() {
+	if (pixels) munmap(pixels, bytes);
+}
+
+bool render_sort_first(const Model& model, const std::vector<TGAColor>& colors, SharedFramebuffer& framebuffer,
+	const SortFirstOptions& options, SortFirstStats* stats) {
+	if (!framebuffer.valid()) return false;
+	const TGAImage& image = framebuffer.image();
+
+	auto split_start = std::chrono::steady_clock::now();
+	std::vector<std::vector<int>> nodes = numa_node_cpus();
+	const int num_nodes = static_cast<int>(nodes.size());
+	int requested = options.processes > 0 ? options.processes : num_nodes;
+	//只在第一次 (或进程数改变时) 划分，之后沿用，横带 i 总是由绑在同一节点上的进程清零和写入
+	double split_ms = 0;
+	if (framebuffer.layout.empty() || framebuffer.layout_requested != requested) {
+		framebuffer.layout = split_bands(model, image.width(), image.height(), requested, band_granule(framebuffer.row_bytes()));
+		framebuffer.layout_requested = requested;
+		split_ms = elapsed_ms(split_start);
+	}
+	std::vector<SortFirstBand> bands = framebuffer.layout;
+	const int num_bands = static_cast<int>(bands.size());
+	for (int i = 0; i < num_bands; i++) {
+		int node = i % num_nodes;
+		int sharing = (num_bands - node + num_nodes - 1) / num_nodes;		//同一节点上的进程数
+		bands[i].node = options.pin ? node : -1;
+		bands[i].threads = options.threads > 0 ? options.threads
+			: std::max(1, static_cast<int>(options.pin ? nodes[node].size() : std::max(1u, std::thread::hardware_concurrency())) / sharing);
+	}
+
+	//工作进程把各自的耗时写回这块共享内存
+	void* timing_mapping = mmap(nullptr, sizeof(double) * num_bands, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	if (timing_mapping == MAP_FAILED) return false;
+	double* timing = static_cast<double*>(timing_mapping);
+
+	auto render_start = std::chrono::steady_clock::now();
+	std::vector<pid_t> workers;
+	bool ok = true;
+	for (int i = 0; i < num_bands; i++) {
+		pid_t pid = fork();
+		if (pid < 0) {
+			ok = false;
+			break;
+		}
+		if (pid == 0) {
+			//子进程: 用 _exit 退出，不执行父进程的静态析构 (父进程的工作线程在这里不存在)
+			int code = 0;
+			try {
+				auto start = std::chrono::steady_clock::now();
+				const SortFirstBand& band = bands[i];
+				if (band.node >= 0) {
+					cpu_set_t set;
+					CPU_ZERO(&set);
+					for (int cpu : nodes[band.node]) CPU_SET(cpu, &set);
+					//绑定失败 (比如被 cgroup 限制) 只是少了 NUMA 局部性，照常渲染
+					(void)sched_setaffinity(0, sizeof(set), &set);
+				}
+				JobSystem::reinit_after_fork(band.threads);
+				render_band(model, colors, framebuffer, band);
+				timing[i] = elapsed_ms(start);
+			}
+			catch (...) {
+				code = 1;
+			}
+			_exit(code);
+		}
+		workers.push_back(pid);
+	}
+
+	for (pid_t pid : workers) {
+		int status = 0;
+		pid_t result;
+		do result = waitpid(pid, &status, 0);
+		while (result < 0 && errno == EINTR);
+		if (result < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0) ok = false;
+	}
+	double render_ms = elapsed_ms(render_start);
+
+	if (stats) {
+		for (int i = 0; i < num_bands; i++) bands[i].ms = timing[i];
+		stats->numa_nodes = num_nodes;
+		stats->bands = bands;
+		stats->split_ms = split_ms;
+		stats->render_ms = render_ms;
+	}
+	munmap(timing_mapping, sizeof(double) * num_bands);
+	return ok;
+}
+
+#else
+
+//没有 fork 的平台: 普通内存，在本进程内一次画完整个画面
+SharedFramebuffer::SharedFramebuffer(int width, int height, int bpp) {
+	stride = static_cast<std::size_t>(std::max(width, 0)) * bpp;
+	bytes = stride * std::max(height, 0);
+	if (bytes == 0) return;
+	pixels = new std::uint8_t[bytes]();
+	view = TGAImage(width, height, bpp, pixels);
+}
+
+SharedFramebuffer::~SharedFramebuffer() {
+	delete[] pixels;
+}
+
+bool render_sort_first(const Model& model, const std::vector<TGAColor>& colors, SharedFramebuffer& framebuffer,
+	const SortFirstOptions&, SortFirstStats* stats) {
+	if (!framebuffer.valid()) return false;
+	auto start = std::chrono::steady_clock::now();
+	SortFirstBand band;
+	band.y1 = framebuffer.image().height() - 1;
+	band.threads = JobSystem::instance().nthreads();
+	framebuffer.layout = { band };
+	framebuffer.layout_requested = 1;
+	render_band(model, colors, framebuffer, band);
+	band.ms = elapsed_ms(start);
+	if (stats) {
+		stats->numa_nodes = 1;
+		stats->bands = { band };
+		stats->split_ms = 0;
+		stats->render_ms = band.ms;
+	}
+	return true;
+}
+
+#endif
@@ -1,8 +1,40 @@
 #include <iostream>
 #include <cstring>
+#include <algorithm>
 #include "../include/tgaimage.h"
+#include "../include/job_system.h"
+#include "../include/profile.h"
 
-TGAImage::TGAImage(const int w, const int h, const int bpp) : w(w), h(h), bpp(bpp), data(w*h*bpp, 0) {}
+TGAImage::TGAImage(const int w, const int h, const int bpp) : w(w), h(h), bpp(bpp), data(size_t(w)*h*bpp, 0), pixels(data.data()) {}
+
+TGAImage::TGAImage(const int w, const int h, const int bpp, std::uint8_t *pixels) : w(w), h(h), bpp(bpp), pixels(pixels) {}
+
+TGAImage::TGAImage(const TGAImage &other) : w(other.w), h(other.h), bpp(other.bpp), data(other.data) {
+    pixels = other.pixels==other.data.data() ? data.data() : other.pixels;
+}
+
+TGAImage::TGAImage(TGAImage &&other) noexcept : w(other.w), h(other.h), bpp(other.bpp), data(std::move(other.data)), pixels(other.pixels) {
+    // moving a vector keeps its buffer, so pixels stays valid in both the owning and the wrapping case
+    other.w = other.h = 0;
+    other.pixels = nullptr;
+}
+
+TGAImage &TGAImage::operator=(const TGAImage &other) {
+    if (this!=&other) *this = TGAImage(other);
+    return *this;
+}
+
+TGAImage &TGAImage::operator=(TGAImage &&other) noexcept {
+    if (this==&other) return *this;
+    w = other.w;
+    h = other.h;
+    bpp = other.bpp;
+    data = std::move(other.data);
+    pixels = other.pixels;
+    other.w = other.h = 0;
+    other.pixels = nullptr;
+    return *this;
+}
 
 bool TGAImage::read_tga_file(const std::string filename) {
     std::ifstream in;
@@ -26,8 +58,9 @@ bool TGAImage::read_tga_file(const std::string filename) {
     }
     size_t nbytes = bpp*w*h;
     data = std::vector<std::uint8_t>(nbytes, 0);
+    pixels = data.data();
     if (3==header.datatypecode || 2==header.datatypecode) {
-        in.read(reinterpret_cast<char *>(data.data()), nbytes);
+        in.read(reinterpret_cast<char *>(pixels), nbytes);
         if (!in.good()) {
             std::cerr << "an error occured while reading the data\n";
             return false;
@@ -70,7 +103,7 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
                     return false;
                 }
                 for (int t=0; t<bpp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
+                    pixels[currentbyte++] = colorbuffer.bgra[t];
                 currentpixel++;
                 if (currentpixel>pixelcount) {
                     std::cerr << "Too many pixels read\n";
@@ -86,7 +119,7 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
             }
             for (int i=0; i<chunkheader; i++) {
                 for (int t=0; t<bpp; t++)
-                    data[currentbyte++] = colorbuffer.bgra[t];
+                    pixels[currentbyte++] = colorbuffer.bgra[t];
                 currentpixel++;
                 if (currentpixel>pixelcount) {
                     std::cerr << "Too many pixels read\n";
@@ -99,6 +132,7 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
 }
 
 bool TGAImage::write_tga_file(const std::string filename, const bool vflip, const bool rle) const {
+    PROFILE_SCOPE("write_tga_file");
     constexpr std::uint8_t developer_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t extension_area_ref[4] = {0, 0, 0, 0};
     constexpr std::uint8_t footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
@@ -117,9 +151,23 @@ bool TGAImage::write_tga_file(const std::string filename, const bool vflip, cons
     out.write(reinterpret_cast<const char *>(&header), sizeof(header));
     if (!out.good()) goto err;
     if (!rle) {
-        out.write(reinterpret_cast<const char *>(data.data()), w*h*bpp);
+        out.write(reinterpret_cast<const char *>(pixels), size_t(w)*h*bpp);
         if (!out.good()) goto err;
-    } else if (!unload_rle_data(out)) goto err;
+    } else {
+        // encode fixed-size bands of scanlines in parallel, packets never cross a band boundary,
+        // so the file is the same whatever the thread count
+        constexpr int band_rows = 32;
+        const int nbands = (h+band_rows-1)/band_rows;
+        std::vector<std::vector<std::uint8_t>> bands(nbands);
+        JobSystem::instance().parallel_for(0, nbands, 1, [&](int lo, int hi) {
+            for (int b=lo; b<hi; b++)
+                unload_rle_data(size_t(b)*band_rows*w, std::min(size_t(b+1)*band_rows, size_t(h))*w, bands[b]);
+        });
+        for (const auto &band : bands) {
+            out.write(reinterpret_cast<const char *>(band.data()), band.size());
+            if (!out.good()) goto err;
+        }
+    }
     out.write(reinterpret_cast<const char *>(developer_area_ref), sizeof(developer_area_ref));
     if (!out.good()) goto err;
     out.write(reinterpret_cast<const char *>(extension_area_ref), sizeof(extension_area_ref));
@@ -132,10 +180,10 @@ err:
     return false;
 }
 
-bool TGAImage::unload_rle_data(std::ofstream &out) const {
+void TGAImage::unload_rle_data(const size_t first, const size_t last, std::vector<std::uint8_t> &out) const {
     const std::uint8_t max_chunk_length = 128;
-    size_t npixels = w*h;
-    size_t curpix = 0;
+    size_t npixels = last;
+    size_t curpix = first;
     while (curpix<npixels) {
         size_t chunkstart = curpix*bpp;
         size_t curbyte = curpix*bpp;
@@ -144,7 +192,7 @@ bool TGAImage::unload_rle_data(std::ofstream &out) const {
         while (curpix+run_length<npixels && run_length<max_chunk_length) {
             bool succ_eq = true;
             for (int t=0; succ_eq && t<bpp; t++)
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bpp]);
+                succ_eq = (pixels[curbyte+t]==pixels[curbyte+t+bpp]);
             curbyte += bpp;
             if (1==run_length)
                 raw = !succ_eq;
@@ -157,39 +205,51 @@ bool TGAImage::unload_rle_data(std::ofstream &out) const {
             run_length++;
         }
         curpix += run_length;
-        out.put(raw ? run_length-1 : run_length+127);
-        if (!out.good()) return false;
-        out.write(reinterpret_cast<const char *>(data.data()+chunkstart), (raw?run_length*bpp:bpp));
-        if (!out.good()) return false;
+        out.push_back(raw ? run_length-1 : run_length+127);
+        out.insert(out.end(), pixels+chunkstart, pixels+chunkstart+(raw?run_length*bpp:bpp));
     }
-    return true;
 }
 
 TGAColor TGAImage::get(const int x, const int y) const {
-    if (!data.size() || x<0 || y<0 || x>=w || y>=h) return {};
+    if (!pixels || x<0 || y<0 || x>=w || y>=h) return {};
     TGAColor ret = {0, 0, 0, 0, bpp};
-    const std::uint8_t *p = data.data()+(x+y*w)*bpp;
+    const std::uint8_t *p = pixels+(x+y*w)*bpp;
     for (int i=bpp; i--; ret.bgra[i] = p[i]);
     return ret;
 }
 
 void TGAImage::set(int x, int y, const TGAColor &c) {
-    if (!data.size() || x<0 || y<0 || x>=w || y>=h) return;
-    memcpy(data.data()+(x+y*w)*bpp, c.bgra, bpp);
+    if (!pixels || x<0 || y<0 || x>=w || y>=h) return;
+    memcpy(pixels+(x+y*w)*bpp, c.bgra, bpp);
+}
+
+void TGAImage::fill_row(const int x0, const int x1, const int y, const TGAColor &c) {
+    std::uint8_t *p = pixels+(x0+y*w)*bpp;
+    for (int x=x0; x<=x1; x++, p+=bpp) memcpy(p, c.bgra, bpp);
+}
+
+void TGAImage::fill_column(const int x, const int y0, const int y1, const TGAColor &c) {
+    std::uint8_t *p = pixels+(x+y0*w)*bpp;
+    const int stride = w*bpp;
+    for (int y=y0; y<=y1; y++, p+=stride) memcpy(p, c.bgra, bpp);
+}
+
+void TGAImage::clear() {
+    std::fill(pixels, pixels+size_t(w)*h*bpp, 0);
 }
 
 void TGAImage::flip_horizontally() {
     for (int i=0; i<w/2; i++)
         for (int j=0; j<h; j++)
             for (int b=0; b<bpp; b++)
-                std::swap(data[(i+j*w)*bpp+b], data[(w-1-i+j*w)*bpp+b]);
+                std::swap(pixels[(i+j*w)*bpp+b], pixels[(w-1-i+j*w)*bpp+b]);
 }
 
 void TGAImage::flip_vertically() {
     for (int i=0; i<w; i++)
         for (int j=0; j<h/2; j++)
             for (int b=0; b<bpp; b++)
-                std::swap(data[(i+j*w)*bpp+b], data[(i+(h-1-j)*w)*bpp+b]);
+                std::swap(pixels[(i+j*w)*bpp+b], pixels[(i+(h-1-j)*w)*bpp+b]);
 }
 
 int TGAImage::width() const {
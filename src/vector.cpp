@@ -116,4 +116,77 @@ void Mat2f::SymEigens(float outEigenValues[2], Mat2f& outEigenVectors) const {
     // v2 = (-sin, cos)
     outEigenVectors.m[0][1] = -s;
     outEigenVectors.m[1][1] = c;
-}
\ No newline at end of file
+}
+
+// ==========================================
+// Mat4f ʵ
+// ==========================================
+
+Mat4f::Mat4f() {
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++)
+            m[i][j] = (i == j) ? 1.0f : 0.0f;
+}
+
+Mat4f Mat4f::Translation(const Vec3f& t) {
+    Mat4f r;
+    r.m[0][3] = t.x;
+    r.m[1][3] = t.y;
+    r.m[2][3] = t.z;
+    return r;
+}
+
+Mat4f Mat4f::Scale(const Vec3f& s) {
+    Mat4f r;
+    r.m[0][0] = s.x;
+    r.m[1][1] = s.y;
+    r.m[2][2] = s.z;
+    return r;
+}
+
+Mat4f Mat4f::RotationY(float angleRad) {
+    float c = std::cos(angleRad);
+    float s = std::sin(angleRad);
+    Mat4f r;
+    r.m[0][0] = c;  r.m[0][2] = s;
+    r.m[2][0] = -s; r.m[2][2] = c;
+    return r;
+}
+
+Mat4f Mat4f::LookAt(const Vec3f& eye, const Vec3f& center, const Vec3f& up) {
+    // ϵ: z ָ󷽣x ңy 
+    Vec3f z = (eye - center).normalize();
+    Vec3f x = up.cross(z).normalize();
+    Vec3f y = z.cross(x).normalize();
+    Mat4f r;
+    r.m[0][0] = x.x; r.m[0][1] = x.y; r.m[0][2] = x.z; r.m[0][3] = -x.dot(center);
+    r.m[1][0] = y.x; r.m[1][1] = y.y; r.m[1][2] = y.z; r.m[1][3] = -y.dot(center);
+    r.m[2][0] = z.x; r.m[2][1] = z.y; r.m[2][2] = z.z; r.m[2][3] = -z.dot(center);
+    return r;
+}
+
+Mat4f Mat4f::Perspective(float focal) {
+    Mat4f r;
+    r.m[3][2] = -1.0f / focal;
+    return r;
+}
+
+Mat4f Mat4f::operator*(const Mat4f& o) const {
+    Mat4f r;
+    for (int i = 0; i < 4; i++)
+        for (int j = 0; j < 4; j++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) sum += m[i][k] * o.m[k][j];
+            r.m[i][j] = sum;
+        }
+    return r;
+}
+
+Vec3f Mat4f::transform_point(const Vec3f& p) const {
+    float x = m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3];
+    float y = m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3];
+    float z = m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3];
+    float w = m[3][0] * p.x + m[3][1] * p.y + m[3][2] * p.z + m[3][3];
+    if (w == 1.0f) return Vec3f(x, y, z);
+    return Vec3f(x / w, y / w, z / w);
+}
@@ -0,0 +1,18 @@
+#include <algorithm>
+#include <limits>
+#include "../include/visibility.h"
+
+VisibilityBuffer::VisibilityBuffer(int width, int height)
+	: ids(width, height, TGAImage::RGBA),
+	  depth(static_cast<size_t>(width) * height, std::numeric_limits<float>::lowest()) {}
+
+void VisibilityBuffer::clear() {
+	ids.clear();
+	std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::lowest());
+}
+
+int VisibilityBuffer::face(int x, int y) const {
+	TGAColor c = ids.get(x, y);
+	std::uint32_t id = c.bgra[0] | (c.bgra[1] << 8) | (c.bgra[2] << 16) | (static_cast<std::uint32_t>(c.bgra[3]) << 24);
+	return id == EMPTY ? -1 : static_cast<int>(id - 1);
+}